@@ -16,20 +16,20 @@ public:
            const Vec3f& u = Vec3f(0,1,0))
         : eye(e), center(c), up(u) {}
 
-    Matrix view() const {
+    Mat4 view() const {
         // базис камеры: z - назад, x - вправо, y - вверх
         Vec3f z = (eye - center).normalize();
         Vec3f x = (up ^ z).normalize();
         Vec3f y = (z ^ x).normalize();
 
-        Matrix m = Matrix::identity(4);
+        Mat4 m = Mat4::identity();
         for (int i = 0; i < 3; ++i) {
             m[0][i] = x[i];
             m[1][i] = y[i];
             m[2][i] = z[i];
         }
 
-        Matrix t = Matrix::identity(4);
+        Mat4 t = Mat4::identity();
         t[0][3] = -eye.x;
         t[1][3] = -eye.y;
         t[2][3] = -eye.z;
@@ -40,13 +40,24 @@ public:
     float zoom = 1.0f;
     float focus = 4.0f;
 
-    Matrix projection() const {
-        Matrix p = Matrix::identity(4);
+    Mat4 projection() const {
+        Mat4 p = Mat4::identity();
         float f = focus / zoom;
         p[3][2] = -1.f / f;
         return p;
     }
 
+    // ViewPort*Projection*View: одна матрица на все вершины кадра
+    Mat4 mvp(const Mat4 &viewport) const {
+        return viewport * projection() * view();
+    }
+
+    // projection() даёт w = 1 - z/f, т.е. лучи сходятся в точке на f позади eye
+    Vec3f projection_center() const {
+        Vec3f z = (eye - center).normalize();
+        return eye + z * (focus / zoom);
+    }
+
     void changeZoom(float factor) {
     zoom *= factor;
 }
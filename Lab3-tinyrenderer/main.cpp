@@ -1,21 +1,46 @@
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
-#include <limits>
+#include <cstring>
+#include <chrono>
+#include <iostream>
 #include "tgaimage.h"
 #include "matrix.h"
 #include "model.h"
 #include "camera.h"
 #include "geometry.h"
 #include "tank.h"
+#include "rasterizer.h"
+#include "shader.h"
+#include "primitive.h"
+#include "wireframe.h"
+#include "multiview.h"
+#include "progressive.h"
+#include "meshlet.h"
+#include "occlusion.h"
+#include "vertex.h"
 
 Model *model = NULL;
-const int width  = 1000;
-const int height = 1000;
+int width  = 1000; // --size N
+int height = 1000;
 const int depth  = 255;
 
-Matrix viewport(int x, int y, int w, int h) {
-    Matrix m = Matrix::identity(4);
+static std::chrono::steady_clock::time_point preview_start;
+
+// --progressive: каждый уровень в preview_S.tga
+static void write_preview(const TGAImage &image, int scale) {
+    std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - preview_start;
+    std::cerr << "# preview 1/" << scale << ": " << ms.count() << " ms" << std::endl;
+    char name[32];
+    snprintf(name, sizeof(name), "preview_%d.tga", scale);
+    TGAImage out(image);
+    out.flip_vertically();
+    out.write_tga_file(name);
+}
+
+Mat4 viewport(int x, int y, int w, int h) {
+    Mat4 m = Mat4::identity();
     m[0][3] = x + w / 2.f;
     m[1][3] = y + h / 2.f;
     m[2][3] = depth / 2.f;
@@ -27,145 +52,438 @@ Matrix viewport(int x, int y, int w, int h) {
     return m;
 }
 
-Vec3f barycentric(Vec3f A, Vec3f B, Vec3f C, Vec3f P) {
-    Vec3f s[2];
-    for (int i=2; i--; ) {
-        s[i][0] = C[i]-A[i];
-        s[i][1] = B[i]-A[i];
-        s[i][2] = A[i]-P[i];
-    }
-
-    Vec3f u = s[0] ^ s[1];
-    
-    if (std::abs(u[2])>1e-2) return Vec3f(1.f-(u.x+u.y)/u.z, u.y/u.z, u.x/u.z);
-    return Vec3f(-1,1,1); // тчк вне треугольника
-}
-
-void line(Vec2i p0, Vec2i p1, TGAImage &image, TGAColor color) {
-    bool steep = false;
-    if (std::abs(p0.x-p1.x)<std::abs(p0.y-p1.y)) {
-        std::swap(p0.x, p0.y);
-        std::swap(p1.x, p1.y);
-        steep = true;
+int main(int argc, char **argv) {
+    int threads = 0; // 0 - по числу ядер
+    RasterMode mode = RASTER_BARYCENTRIC;
+    bool hiz = false;
+    bool deferred = false;
+    int msaa = 1;
+    VrsPolicy vrs = NULL;
+    bool sort = false;
+    bool micro = false;
+    CullMode cull = CULL_BACK;
+    DepthFormat depth_format = DEPTH_32F;
+    bool wire = false;    // только каркас
+    bool overlay = false; // каркас поверх треугольников, скрытые линии убраны
+    bool progressive = false; // уровни 1/8 .. 1 с превью, ручной путь и танк
+    bool meshlets = false; // отбрасывать мешлеты до преобразования вершин
+    bool occlusion = false; // и закрытые другими мешлетами (буфер 1/4 разрешения)
+    Vec3f eye(0, 0, 1);
+    int views = 0; // N камер по кругу вокруг модели, view_K.tga
+    int crop[4] = { 0, 0, 0, 0 }; // x y w h окна кадра, y снизу; w=0 - весь кадр
+    const char *obj = "obj/almost_african_head.obj"; // текстура - рядом, с суффиксом _diffuse.tga
+    bool mesh_cache = true; // <obj>.meshcache рядом с моделью, --no-cache - без него
+    bool compact = false; // позиции и uv 16 бит, нормали октаэдром
+    const char *shader = NULL; // flat, gouraud, phong; NULL - ручной путь
+    int bench = 0; // повторить растеризацию N раз и вывести среднее время
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i+1<argc) threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--edge")) mode = RASTER_EDGE;
+        else if (!strcmp(argv[i], "--fixed")) mode = RASTER_FIXED;
+        else if (!strcmp(argv[i], "--hiz")) hiz = true;
+        else if (!strcmp(argv[i], "--deferred")) deferred = true;
+        else if (!strcmp(argv[i], "--sort")) sort = true;
+        else if (!strcmp(argv[i], "--msaa") && i+1<argc) msaa = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--vrs") && i+1<argc) {
+            i++;
+            if (!strcmp(argv[i], "2x2")) vrs = vrs_2x2;
+            else if (!strcmp(argv[i], "4x4")) vrs = vrs_4x4;
+            else vrs = vrs_texel_density;
+        }
+        else if (!strcmp(argv[i], "--shader") && i+1<argc) shader = argv[++i];
+        else if (!strcmp(argv[i], "--bench") && i+1<argc) bench = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--micro")) micro = true;
+        else if (!strcmp(argv[i], "--wire")) wire = true;
+        else if (!strcmp(argv[i], "--overlay")) overlay = true;
+        else if (!strcmp(argv[i], "--depth") && i+1<argc) {
+            int bits = atoi(argv[++i]);
+            depth_format = bits==16 ? DEPTH_16 : bits==24 ? DEPTH_24 : DEPTH_32F;
+        }
+        else if (!strcmp(argv[i], "--cull") && i+1<argc) {
+            i++;
+            if (!strcmp(argv[i], "none")) cull = CULL_NONE;
+            else if (!strcmp(argv[i], "front")) cull = CULL_FRONT;
+            else cull = CULL_BACK;
+        }
+        else if (!strcmp(argv[i], "--eye") && i+3<argc) {
+            eye.x = atof(argv[++i]);
+            eye.y = atof(argv[++i]);
+            eye.z = atof(argv[++i]);
+        }
+        // меньше картинка - мельче треугольники головы; больше 4095 нельзя - координаты
+        // вершин с guard band должны оставаться меньше 4096 (PrimitiveStage)
+        else if (!strcmp(argv[i], "--size") && i+1<argc) width = height = std::min(4095, std::max(64, atoi(argv[++i])));
+        else if (!strcmp(argv[i], "--progressive")) progressive = true;
+        else if (!strcmp(argv[i], "--meshlets")) meshlets = true;
+        else if (!strcmp(argv[i], "--occlusion")) meshlets = occlusion = true;
+        else if (!strcmp(argv[i], "--model") && i+1<argc) obj = argv[++i];
+        else if (!strcmp(argv[i], "--no-cache")) mesh_cache = false;
+        else if (!strcmp(argv[i], "--compact")) compact = true;
+        else if (!strcmp(argv[i], "--views") && i+1<argc) views = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--crop") && i+4<argc)
+            for (int k=0; k<4; k++) crop[k] = atoi(argv[++i]);
     }
-    if (p0.x>p1.x) {
-        std::swap(p0.x, p1.x);
-        std::swap(p0.y, p1.y);
+    // уровни --progressive рисуются ручным путём: из режимов - только растеризатор,
+    // глубина, потоки, мешлеты и окно
+    if (progressive) {
+        const char *other = hiz ? "--hiz" : deferred ? "--deferred" : msaa>1 ? "--msaa" : vrs ? "--vrs"
+                          : shader ? "--shader" : wire ? "--wire" : overlay ? "--overlay" : micro ? "--micro"
+                          : bench>0 ? "--bench" : views>0 ? "--views" : NULL;
+        if (other) {
+            std::cerr << "--progressive can't be combined with " << other << std::endl;
+            return 1;
+        }
     }
-
-    for (int x=p0.x; x<=p1.x; x++) {
-        float t = (x-p0.x)/(float)(p1.x-p0.x);
-        int y = p0.y*(1.-t) + p1.y*t;
-        if (steep) {
-            image.set(y, x, color);
-        } else image.set(x, y, color);
+    // Hi-Z растеризатор не ведёт для сэмплов MSAA, а пакеты мелких треугольников
+    // есть только без Hi-Z: такое сочетание - ошибка, а не молча другой режим
+    if (hiz && (msaa>1 || micro)) {
+        std::cerr << "--hiz can't be combined with " << (msaa>1 ? "--msaa" : "--micro") << std::endl;
+        return 1;
     }
-}
-
-void triangle(Vec3i *pts, Vec2f *uvs, float *zbuffer, TGAImage &image, float intensity) {
-    Vec2i bboxmin(image.get_width()-1,  image.get_height()-1);
-    Vec2i bboxmax(0, 0);
-    Vec2i clamp(image.get_width()-1, image.get_height()-1);
-    
-    for (int i=0; i<3; i++) {
-        for (int j=0; j<2; j++) {
-            bboxmin.raw[j] = std::max(0, std::min(bboxmin.raw[j], pts[i].raw[j]));
-            bboxmax.raw[j] = std::min(clamp.raw[j], std::max(bboxmax.raw[j], pts[i].raw[j]));
+    // шейдеры растеризуются рёбрами по 8 пикселей (как --edge), с Hi-Z и отложенным
+    // шейдингом, но без сэмплов MSAA, VRS, 28.4 и пакетов мелких треугольников
+    if (shader) {
+        const char *other = mode==RASTER_FIXED ? "--fixed" : msaa>1 ? "--msaa" : vrs ? "--vrs"
+                          : micro ? "--micro" : wire ? "--wire" : NULL;
+        if (other) {
+            std::cerr << "--shader can't be combined with " << other << std::endl;
+            return 1;
         }
     }
-    
-    Vec3f P;
-    for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++) {
-        for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++) {
-            
-            Vec3f bc_screen = barycentric(Vec3f(pts[0].x, pts[0].y, pts[0].z), 
-                Vec3f(pts[1].x, pts[1].y, pts[1].z), Vec3f(pts[2].x, pts[2].y, pts[2].z), P);
-            
-            if (bc_screen.x<0 || bc_screen.y<0 || bc_screen.z<0) continue;
-            
-            P.z = 0;
-            P.z += pts[0].z * bc_screen.x;
-            P.z += pts[1].z * bc_screen.y;
-            P.z += pts[2].z * bc_screen.z;
-            
-            int idx = int(P.x) + int(P.y)*width;
-            if (zbuffer[idx] < P.z) {
-                zbuffer[idx] = P.z;
-                
-                Vec2f uv;
-                uv.x = uvs[0].x * bc_screen.x + uvs[1].x * bc_screen.y + uvs[2].x * bc_screen.z;
-                uv.y = uvs[0].y * bc_screen.x + uvs[1].y * bc_screen.y + uvs[2].y * bc_screen.z;
-                
-                TGAColor color = model->diffuse(uv);
-                
-                color.r *= intensity;
-                color.g *= intensity;
-                color.b *= intensity;
-                
-                image.set(P.x, P.y, color);
-            }
+    // виды рисуются ручным путём во весь кадр: из режимов - только растеризатор,
+    // отбраковка, глубина, потоки и компактная модель
+    if (views>0) {
+        const char *other = crop[2]>0 && crop[3]>0 ? "--crop" : hiz ? "--hiz" : deferred ? "--deferred"
+                          : msaa>1 ? "--msaa" : vrs ? "--vrs" : micro ? "--micro" : occlusion ? "--occlusion"
+                          : meshlets ? "--meshlets" : shader ? "--shader" : wire ? "--wire"
+                          : overlay ? "--overlay" : sort ? "--sort" : NULL;
+        if (other) {
+            std::cerr << "--views can't be combined with " << other << std::endl;
+            return 1;
         }
     }
-}
+    // окно обрезается по кадру; треугольники и лучи вне окна отбрасываются сразу
+    TileRect window = { 0, 0, width-1, height-1 };
+    if (crop[2]>0 && crop[3]>0) {
+        window.x0 = std::max(0, std::min(crop[0], width-1));
+        window.y0 = std::max(0, std::min(crop[1], height-1));
+        window.x1 = std::max(window.x0, std::min(width-1, crop[0] + crop[2] - 1));
+        window.y1 = std::max(window.y0, std::min(height-1, crop[1] + crop[3] - 1));
+    }
+    int window_w = window.x1 - window.x0 + 1, window_h = window.y1 - window.y0 + 1;
+
+    model = new Model(obj, threads, mesh_cache);
+    VertexBuffer positions;
+    if (compact) {
+        CompactStats cs = model->compact();
+        std::cerr << "# compact: " << cs.bytes_before/1024 << " KB -> " << cs.bytes_after/1024
+                  << " KB, vertex stage reads 6 B/vertex instead of 16; max error position " << cs.position_error
+                  << " (bound " << cs.position_bound << "), uv " << cs.uv_error << " (bound " << cs.uv_bound
+                  << "), normal " << cs.normal_error << " deg" << std::endl;
+    } else {
+        load_positions(*model, positions);
+    }
+    // компактная модель читается вершинной стадией напрямую
+    auto vertex_stage = [&](const Mat4 &transform, VertexBuffer &out) {
+        if (compact) transform_vertices(model->quantized(), transform, threads, out);
+        else transform_vertices(positions, transform, threads, out);
+    };
 
+    std::vector<Meshlet> clusters;
+    std::vector<int> cluster_faces;
+    if (meshlets) {
+        build_meshlets(*model, clusters, cluster_faces);
+        std::cerr << "# meshlets: " << clusters.size() << " for " << model->nfaces() << " faces" << std::endl;
+    }
 
-int main() {
-    model = new Model("obj/almost_african_head.obj");
+    TGAImage image(window_w, window_h, TGAImage::RGB);
 
-    TGAImage image(width, height, TGAImage::RGB);
-    
-    float *zbuffer = new float[width*height];
-    for (int i=0; i<width*height; i++) 
-        zbuffer[i] = -std::numeric_limits<float>::max();
+    Rasterizer rasterizer(window_w, window_h);
+    rasterizer.set_origin(window.x0, window.y0);
+    rasterizer.set_threads(threads);
+    rasterizer.set_mode(mode);
+    rasterizer.set_hiz(hiz);
+    rasterizer.set_deferred(deferred);
+    rasterizer.set_msaa(msaa);
+    rasterizer.set_vrs(vrs);
+    rasterizer.set_micro_batch(micro);
+    rasterizer.set_depth_format(depth_format, 0.f, depth);
 
 	Camera camera(
-        Vec3f(0, 0, 1), // eye
+        eye,
         Vec3f(0, 0, 0), // center
         Vec3f(0, 1, 0) // up
     );
 
-    Matrix View = camera.view();
-    Matrix Projection = camera.projection();
-    Matrix ViewPort = viewport(width/8, height/8, width*3/4, height*3/4);
+    Mat4 ViewPort = viewport(width/8, height/8, width*3/4, height*3/4);
 
     Vec3f light_dir(0,0,-1);
 
-    for (int i=0; i<model->nfaces(); i++) {
-        std::vector<int> face = model->face(i);
-        std::vector<int> face_uv = model->face_uv(i);
+    if (views>0) {
+        static const float PI = 3.14159265f;
+        std::vector<Camera> cameras;
+        float r = std::sqrt(eye.x*eye.x + eye.z*eye.z);
+        for (int i=0; i<views; i++) {
+            float a = std::atan2(eye.x, eye.z) + 2.f*PI*i/views;
+            cameras.push_back(Camera(Vec3f(r*std::sin(a), eye.y, r*std::cos(a)), Vec3f(0, 0, 0), Vec3f(0, 1, 0)));
+        }
+        ViewOptions opt;
+        opt.mode = mode;
+        opt.cull = cull;
+        opt.depth = depth_format;
+        opt.zfar = depth;
+        opt.threads = threads;
+
+        auto start = std::chrono::steady_clock::now();
+        MeshSetup mesh;
+        setup_mesh(*model, light_dir, mesh);
+        std::chrono::duration<double, std::milli> setup_ms = std::chrono::steady_clock::now() - start;
+
+        std::vector<TGAImage> images(views, TGAImage(width, height, TGAImage::RGB));
+        int runs = std::max(1, bench);
+        start = std::chrono::steady_clock::now();
+        for (int k=0; k<runs; k++) render_views(mesh, *model, cameras, ViewPort, opt, images);
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+        std::cerr << "# views: " << views << " in " << ms.count()/runs << " ms, setup "
+                  << setup_ms.count() << " ms" << std::endl;
+
+        // для сравнения: каждый вид отдельным кадром, как в обычном пути
+        if (bench) {
+            std::vector<TGAImage> one(1, TGAImage(width, height, TGAImage::RGB));
+            start = std::chrono::steady_clock::now();
+            for (int k=0; k<runs; k++)
+                for (int i=0; i<views; i++) {
+                    MeshSetup single;
+                    setup_mesh(*model, light_dir, single);
+                    render_views(single, *model, std::vector<Camera>(1, cameras[i]), ViewPort, opt, one);
+                }
+            ms = std::chrono::steady_clock::now() - start;
+            std::cerr << "# views: one by one " << ms.count()/runs << " ms" << std::endl;
+        }
+
+        // танк от камеры не зависит: в каждом виде тот же, что в обычном кадре
+        for (int i=0; i<views; i++) {
+            render_tank(images[i]);
+            char name[32];
+            snprintf(name, sizeof(name), "view_%d.tga", i);
+            images[i].flip_vertically();
+            images[i].write_tga_file(name);
+        }
+        delete model;
+        return 0;
+    }
 
-        Vec3i screen_coords[3];
-        Vec3f world_coords[3];
-        Vec2f uv_coords[3];
+    Mat4 transform = camera.mvp(ViewPort);
 
-        for (int j=0; j<3; j++) {
-            Vec3f v = model->vert(face[j]);
-            world_coords[j]  = v;
-            
-			Matrix v4 = embed(v); // (x,y,z,1)
-			Matrix clip = ViewPort * Projection * View * v4;
-			Vec3f screenf = project(clip); // перспективное деление
-			screen_coords[j] = Vec3i(
-				int(screenf.x + 0.5f),
-				int(screenf.y + 0.5f),
-				int(screenf.z + 0.5f)
-			);
+    // отсечение и отбраковка граней - в PrimitiveStage, освещённость от них не зависит
+    PrimitiveStage primitives(width, height);
+    primitives.set_cull(cull);
+    std::vector<RasterTriangle> tris;
+    tris.reserve(model->nfaces());
+    // мешлеты отбрасываются целиком, порядок оставшихся граней прежний
+    std::vector<unsigned char> face_visible;
+    if (meshlets) {
+        MeshletStats ms;
+        cull_meshlets(clusters, cluster_faces, transform, width, height, camera.projection_center(), cull,
+                      face_visible, ms);
+        std::cerr << "# meshlets culled: frustum " << ms.frustum << " backface " << ms.backface
+                  << " of " << ms.meshlets << ", faces skipped " << ms.faces << std::endl;
+    }
+    if (occlusion) {
+        auto start = std::chrono::steady_clock::now();
+        // весь экран в [-1, 1]
+        Mat4 ndc = Mat4::identity();
+        ndc[0][0] = 2.f/width;
+        ndc[0][3] = -1.f;
+        ndc[1][1] = 2.f/height;
+        ndc[1][3] = -1.f;
+        Mat4 m = ndc * transform;
+        float mf[16];
+        for (int i=0; i<16; i++) mf[i] = m[i/4][i%4];
+
+        OcclusionBuffer occluders(std::max(8, width/4), std::max(8, height/4));
+        occluders.set_transform(mf);
+        occluders.clear();
+        // окклюдеры - грани мешлетов, прошедших отсечение выше
+        std::vector<Vec3f> verts(model->nverts());
+        for (int i=0; i<model->nverts(); i++) verts[i] = model->vert(i);
+        std::vector<unsigned int> indices;
+        for (int i=0; i<model->nfaces(); i++) {
+            if (!face_visible[i]) continue;
+            Span<int> face = model->face(i);
+            for (int j=0; j<3; j++) indices.push_back(face[j]);
+        }
+        // без граней (пустой OBJ или всё отсечено) буфер остаётся пустым и ничего не закрывает
+        if (!indices.empty())
+            occluders.add_occluders(&verts.data()->x, sizeof(Vec3f), indices.data(), (int)indices.size()/3);
 
-			uv_coords[j] = model->uv(face_uv[j]);
+        long long faces = 0;
+        for (size_t i=0; i<clusters.size(); i++) {
+            const Meshlet &c = clusters[i];
+            if (!face_visible[cluster_faces[c.first]]) continue;
+            if (occluders.box_visible(&c.lo.x, &c.hi.x)) continue;
+            for (int j=c.first; j<c.first+c.count; j++) face_visible[cluster_faces[j]] = 0;
+            faces += c.count;
         }
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+        const OcclusionStats &os = occluders.stats();
+        std::cerr << "# occlusion: occluders " << os.occluders << ", meshlets tested " << os.tested
+                  << " occluded " << os.occluded << " offscreen " << os.offscreen
+                  << ", faces skipped " << faces << ", " << ms.count() << " ms" << std::endl;
+    }
+    // каждая вершина преобразуется один раз, грани только берут её по индексу
+    VertexBuffer screen;
+    vertex_stage(transform, screen);
+    if (bench>0) {
+        // для сравнения: прежний путь, преобразование на каждый угол грани
+        std::vector<Vec4f> corners(model->nfaces()*3), cached(model->nfaces()*3);
+        auto start = std::chrono::steady_clock::now();
+        for (int k=0; k<bench; k++)
+            for (int i=0; i<model->nfaces(); i++) {
+                Span<int> face = model->face(i);
+                for (int j=0; j<3; j++) corners[i*3+j] = transform * Vec4f(model->vert(face[j]), 1.f);
+            }
+        std::chrono::duration<double, std::milli> per_corner = std::chrono::steady_clock::now() - start;
+        start = std::chrono::steady_clock::now();
+        for (int k=0; k<bench; k++) {
+            vertex_stage(transform, screen);
+            for (int i=0; i<model->nfaces(); i++) {
+                Span<int> face = model->face(i);
+                for (int j=0; j<3; j++) cached[i*3+j] = screen.at(face[j]);
+            }
+        }
+        std::chrono::duration<double, std::milli> batched = std::chrono::steady_clock::now() - start;
+        bool same = !memcmp(corners.data(), cached.data(), corners.size()*sizeof(Vec4f));
+        std::cerr << "# vertices: " << model->nverts() << " for " << corners.size() << " corners, per-corner "
+                  << per_corner.count()/bench << " ms, batched " << batched.count()/bench << " ms ("
+                  << per_corner.count()/std::max(1e-9, batched.count()) << "x)"
+                  << (same ? "" : ", results differ") << std::endl;
+    }
+    auto assemble = [&]() {
+        tris.clear();
+        for (int i=0; i<model->nfaces(); i++) {
+            if (meshlets && !face_visible[i]) continue;
+            Span<int> face = model->face(i);
+            Span<int> face_uv = model->face_uv(i);
+
+            ClipVertex clip[3];
+            for (int j=0; j<3; j++) clip[j] = ClipVertex(screen.at(face[j]), model->uv(face_uv[j]));
 
-        Vec3f n = (world_coords[2]-world_coords[0])^(world_coords[1]-world_coords[0]);
-        n.normalize();
-        float intensity = n*light_dir; // cos угла между ними
+            float intensity = std::max(0.f, model->face_normal(i)*light_dir); // cos угла между ними, тыльная к свету сторона - чёрная
 
-        if (intensity>0) triangle(screen_coords, uv_coords, zbuffer, image, intensity);
+            primitives.add(clip, intensity, tris);
+        }
+    };
+    assemble();
+    const PrimitiveStats &ps = primitives.stats();
+    std::cerr << "# primitives: in " << ps.input << " out " << ps.output << ", culled frustum " << ps.frustum
+              << " backface " << ps.backface << " zero-area " << ps.zero_area
+              << ", clipped " << ps.clipped << std::endl;
+
+    FlatShader    flat(model, light_dir);
+    GouraudShader gouraud(model, light_dir);
+    PhongShader   phong(model, light_dir);
+    // шейдеры берут те же преобразованные вершины; в замер у них входит стадия примитивов
+    const unsigned char *shaded_faces = meshlets ? face_visible.data() : NULL;
+    std::vector<RasterLine> lines;
+    if (wire || overlay) {
+        lines = wire_lines(*model, screen, width, height);
+        std::cerr << "# wireframe: " << lines.size() << " unique edges" << std::endl;
+    }
+    const TGAColor wire_color(255, 255, 255, 255);
+    RasterStats frame; // stats() - только за последний draw, тут - за кадр
+    auto render_to = [&](TGAImage &target) {
+        if (wire) {
+            rasterizer.draw_lines(lines, *model, target, wire_color, false);
+            frame = rasterizer.stats();
+            return;
+        }
+        if (!shader) rasterizer.draw(tris, *model, target);
+        else if (!strcmp(shader, "gouraud")) rasterizer.draw_shaded(gouraud, screen, primitives, *model, target, shaded_faces);
+        else if (!strcmp(shader, "phong"))   rasterizer.draw_shaded(phong, screen, primitives, *model, target, shaded_faces);
+        else rasterizer.draw_shaded(flat, screen, primitives, *model, target, shaded_faces);
+        frame = rasterizer.stats();
+        if (overlay) {
+            rasterizer.draw_lines(lines, *model, target, wire_color, true);
+            frame += rasterizer.stats();
+        }
+    };
+    auto render = [&]() { render_to(image); };
+
+    if (sort) {
+        // для сравнения: сколько фрагментов отбросил z-тест без сортировки
+        TGAImage scratch(window_w, window_h, TGAImage::RGB);
+        render_to(scratch);
+        RasterStats unsorted = frame;
+        rasterizer.clear();
+        rasterizer.set_front_to_back(true);
+        render_to(scratch);
+        RasterStats sorted = frame;
+        rasterizer.clear();
+        std::cerr << "# front-to-back: rejected by z-test " << unsorted.covered - unsorted.shaded
+                  << " unsorted, " << sorted.covered - sorted.shaded << " sorted" << std::endl;
     }
 
-    render_tank(image);
+    if (progressive) {
+        ViewOptions opt;
+        opt.mode = mode;
+        opt.depth = depth_format;
+        opt.zfar = depth;
+        opt.threads = threads;
+        preview_start = std::chrono::steady_clock::now();
+        ProgressiveStats ps = render_progressive(tris, *model, opt, window.x0, window.y0, image, write_preview);
+        frame = ps.raster;
+        std::cerr << "# progressive: tank rays " << ps.rays << ", reused " << ps.reused << std::endl;
+    } else if (bench>0) {
+        if (shader) {
+            // для сравнения в том же запуске: ручной путь тех же граней тем же растеризатором
+            // рёбер, тоже со стадией примитивов
+            TGAImage scratch(window_w, window_h, TGAImage::RGB);
+            rasterizer.set_mode(RASTER_EDGE);
+            auto start = std::chrono::steady_clock::now();
+            for (int i=0; i<bench; i++) {
+                rasterizer.clear();
+                assemble();
+                rasterizer.draw(tris, *model, scratch);
+            }
+            std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+            rasterizer.set_mode(mode);
+            std::cerr << "# raster hand-written " << ms.count()/bench << " ms/frame" << std::endl;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int i=0; i<bench; i++) {
+            rasterizer.clear();
+            render();
+        }
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+        std::cerr << "# raster ";
+        if (shader) std::cerr << shader << " shader ";
+        std::cerr << ms.count()/bench << " ms/frame, threads " << rasterizer.threads() << std::endl;
+    } else {
+        render();
+    }
+    // covered - shaded = фрагменты, отброшенные z-тестом; при правиле top-left
+    // пиксели общих рёбер больше не считаются дважды
+    std::cerr << "# fragments covered " << frame.covered
+              << " shaded " << frame.shaded << std::endl;
+    if (vrs) std::cerr << "# vrs: diffuse calls " << frame.coarse << std::endl;
+    if (deferred) std::cerr << "# deferred: diffuse calls " << frame.resolved << std::endl;
+    if (hiz) std::cerr << "# hi-z culled tiles " << frame.hiz_tiles
+                       << " blocks " << frame.hiz_blocks << std::endl;
+    // clear() ничего не пишет: глубина чистится по тайлам, в которые попали треугольники
+    std::cerr << "# depth: " << (depth_format==DEPTH_16 ? 16 : depth_format==DEPTH_24 ? 24 : 32)
+              << "-bit, buffer " << rasterizer.depth_bytes()/1024 << " KB, cleared "
+              << frame.depth_cleared/1024 << " KB/frame" << std::endl;
+    if (micro) std::cerr << "# micro: triangles " << frame.micro
+                         << " batches " << frame.micro_batches << std::endl;
+
+    if (wire || overlay) std::cerr << "# wireframe: pixels " << frame.line_pixels
+                                   << " hidden " << frame.line_hidden << std::endl;
+
+    if (!progressive) render_tank(image, window.x0, window.y0); // уже внутри render_progressive
 
     image.flip_vertically(); 
     image.write_tga_file("output.tga");
 
-    delete [] zbuffer;
     delete model;
 }
\ No newline at end of file
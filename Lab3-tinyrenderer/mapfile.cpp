@@ -0,0 +1,93 @@
+#include "mapfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char EMPTY[1] = { 0 };
+
+#ifdef _WIN32
+
+MappedFile::MappedFile() : data_(NULL), size_(0), mtime_(0), mapped_(false), file_(NULL), mapping_(NULL) {}
+
+bool MappedFile::open(const char *filename) {
+    close();
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file==INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) { CloseHandle(file); return false; }
+    file_ = file;
+    size_ = (size_t)size.QuadPart;
+    FILETIME written;
+    if (GetFileTime(file, NULL, NULL, &written))
+        mtime_ = ((long long)written.dwHighDateTime << 32) | written.dwLowDateTime;
+    if (size_==0) { data_ = EMPTY; return true; }
+    mapping_ = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_) data_ = (const char *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (!data_) { close(); return false; }
+    mapped_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_) CloseHandle(file_);
+    data_ = NULL;
+    size_ = 0;
+    mtime_ = 0;
+    mapped_ = false;
+    file_ = mapping_ = NULL;
+}
+
+#else
+
+MappedFile::MappedFile() : data_(NULL), size_(0), mtime_(0), mapped_(false) {}
+
+bool MappedFile::open(const char *filename) {
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd<0) return false;
+    struct stat st;
+    if (fstat(fd, &st)!=0) { ::close(fd); return false; }
+    size_ = (size_t)st.st_size;
+#ifdef __APPLE__
+    mtime_ = (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    mtime_ = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    if (size_==0) {
+        ::close(fd);
+        data_ = EMPTY;
+        return true;
+    }
+    void *p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // отображение держит файл само
+    if (p==MAP_FAILED) { size_ = 0; return false; }
+    madvise(p, size_, MADV_SEQUENTIAL);
+    data_ = (const char *)p;
+    mapped_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped_) munmap((void *)data_, size_);
+    data_ = NULL;
+    size_ = 0;
+    mtime_ = 0;
+    mapped_ = false;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
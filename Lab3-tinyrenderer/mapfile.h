@@ -0,0 +1,34 @@
+// mapfile.h
+#ifndef __MAPFILE_H__
+#define __MAPFILE_H__
+
+#include <cstddef>
+
+// файл только для чтения, целиком отображённый в память
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // false, если файл не открылся; пустой файл - data() непустой указатель, size() 0
+    bool open(const char *filename);
+    void close();
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+    // время последней записи файла: наносекунды (POSIX) или 100 нс (Windows)
+    long long mtime() const { return mtime_; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    const char *data_;
+    size_t size_;
+    long long mtime_;
+    bool mapped_;
+#ifdef _WIN32
+    void *file_, *mapping_;
+#endif
+};
+
+#endif // __MAPFILE_H__
@@ -2,63 +2,74 @@
 #ifndef __MATRIX_H__
 #define __MATRIX_H__
 
-#include <vector>
-#include <cassert>
 #include "geometry.h"
+#include "simd.h"
 
-class Matrix {
-public:
-    int rows, cols;
-    std::vector<std::vector<float>> data;
+// преобразования вершин - Mat4/Vec4f фиксированного размера на стеке, выровненные под SSE
 
-    Matrix(int r=4, int c=4) : rows(r), cols(c), data(r, std::vector<float>(c, 0.f)) {}
+// строка Mat4 или точка в однородных координатах
+struct alignas(16) Vec4f {
+    float x, y, z, w;
 
-    static Matrix identity(int n) {
-        Matrix m(n, n);
-        for (int i = 0; i < n; ++i) m[i][i] = 1.f;
-        return m;
-    }
+    constexpr Vec4f() : x(0), y(0), z(0), w(0) {}
+    constexpr Vec4f(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+    Vec4f(const Vec3f &v, float _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
 
-    std::vector<float>& operator[](int r) {
-        assert(r >= 0 && r < rows);
-        return data[r];
-    }
+    float & operator[](int i) { return (&x)[i]; }
+    const float & operator[](int i) const { return (&x)[i]; }
+};
 
-    const std::vector<float>& operator[](int r) const {
-        assert(r >= 0 && r < rows);
-        return data[r];
+struct alignas(16) Mat4 {
+    Vec4f rows[4];
+
+    constexpr Mat4() : rows() {}
+    constexpr Mat4(const Vec4f &r0, const Vec4f &r1, const Vec4f &r2, const Vec4f &r3) : rows{ r0, r1, r2, r3 } {}
+
+    static constexpr Mat4 identity() {
+        return Mat4(Vec4f(1, 0, 0, 0), Vec4f(0, 1, 0, 0), Vec4f(0, 0, 1, 0), Vec4f(0, 0, 0, 1));
     }
+
+    Vec4f & operator[](int r) { return rows[r]; }
+    const Vec4f & operator[](int r) const { return rows[r]; }
 };
 
-inline Matrix operator*(const Matrix& a, const Matrix& b) {
-    assert(a.cols == b.rows);
-    Matrix result(a.rows, b.cols);
-    for (int i = 0; i < a.rows; ++i) {
-        for (int j = 0; j < b.cols; ++j) {
-            float sum = 0.f;
-            for (int k = 0; k < a.cols; ++k) {
-                sum += a.data[i][k] * b.data[k][j];
-            }
-            result[i][j] = sum;
-        }
+// суммы идут по k по порядку, одинаково в SIMD и скалярной ветке: результат тот же до бита
+inline Mat4 operator*(const Mat4 &a, const Mat4 &b) {
+    Mat4 r;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    __m128 b0 = _mm_load_ps(&b[0].x), b1 = _mm_load_ps(&b[1].x), b2 = _mm_load_ps(&b[2].x), b3 = _mm_load_ps(&b[3].x);
+    for (int i=0; i<4; i++) {
+        __m128 acc = _mm_mul_ps(_mm_set1_ps(a[i].x), b0);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[i].y), b1));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[i].z), b2));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[i].w), b3));
+        _mm_store_ps(&r[i].x, acc);
     }
-    return result;
+#else
+    for (int i=0; i<4; i++)
+        for (int j=0; j<4; j++)
+            r[i][j] = a[i][0]*b[0][j] + a[i][1]*b[1][j] + a[i][2]*b[2][j] + a[i][3]*b[3][j];
+#endif
+    return r;
 }
 
-// "запаковать" Vec3f в однородные координаты (x,y,z,1)^T
-inline Matrix embed(const Vec3f& v) {
-    Matrix m(4, 1);
-    m[0][0] = v.x;
-    m[1][0] = v.y;
-    m[2][0] = v.z;
-    m[3][0] = 1.f;
-    return m;
+inline Vec4f operator*(const Mat4 &m, const Vec4f &v) {
+    Vec4f r;
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    // произведения строк на v, транспонирование, сумма столбцов = 4 скалярных произведения
+    __m128 vv = _mm_load_ps(&v.x);
+    __m128 p0 = _mm_mul_ps(_mm_load_ps(&m[0].x), vv), p1 = _mm_mul_ps(_mm_load_ps(&m[1].x), vv);
+    __m128 p2 = _mm_mul_ps(_mm_load_ps(&m[2].x), vv), p3 = _mm_mul_ps(_mm_load_ps(&m[3].x), vv);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    _mm_store_ps(&r.x, _mm_add_ps(_mm_add_ps(_mm_add_ps(p0, p1), p2), p3));
+#else
+    for (int i=0; i<4; i++) r[i] = m[i][0]*v.x + m[i][1]*v.y + m[i][2]*v.z + m[i][3]*v.w;
+#endif
+    return r;
 }
 
-// "распаковать" обратно: делим на w (перспектива)
-inline Vec3f project(const Matrix& m) {
-    float w = m[3][0];
-    return Vec3f(m[0][0] / w, m[1][0] / w, m[2][0] / w);
+inline Vec3f project(const Vec4f &v) {
+    return Vec3f(v.x / v.w, v.y / v.w, v.z / v.w);
 }
 
 #endif // __MATRIX_H__
@@ -0,0 +1,136 @@
+#include <cmath>
+#include <algorithm>
+#include "meshlet.h"
+
+void build_meshlets(Model &model, std::vector<Meshlet> &meshlets, std::vector<int> &faces) {
+    int nfaces = model.nfaces(), nverts = model.nverts();
+    std::vector<Vec3i> tri(nfaces);
+    std::vector<Vec3f> normal(nfaces);
+    std::vector<unsigned char> degenerate(nfaces, 0);
+    for (int i=0; i<nfaces; i++) {
+        Span<int> face = model.face(i);
+        tri[i] = Vec3i(face[0], face[1], face[2]);
+        // у модели нормаль (v2-v0)^(v1-v0), здесь обход в другую сторону
+        normal[i] = model.face_normal(i)*-1.f;
+        degenerate[i] = normal[i].norm()==0;
+    }
+
+    // грани вершины: CSR, vert_first[v] .. vert_first[v+1]
+    std::vector<int> vert_first(nverts+1, 0), vert_faces(nfaces*3);
+    for (int i=0; i<nfaces; i++)
+        for (int j=0; j<3; j++) vert_first[tri[i][j]+1]++;
+    for (int v=0; v<nverts; v++) vert_first[v+1] += vert_first[v];
+    std::vector<int> fill(vert_first.begin(), vert_first.end()-1);
+    for (int i=0; i<nfaces; i++)
+        for (int j=0; j<3; j++) vert_faces[fill[tri[i][j]]++] = i;
+
+    meshlets.clear();
+    faces.clear();
+    faces.reserve(nfaces);
+    std::vector<unsigned char> used(nfaces, 0);
+    for (int seed=0; seed<nfaces; seed++) {
+        if (used[seed]) continue;
+        Meshlet m;
+        m.first = (int)faces.size();
+        used[seed] = 1;
+        faces.push_back(seed);
+        // очередь - это сам хвост faces
+        for (size_t q = m.first; q<faces.size() && (int)faces.size()-m.first<MESHLET_SIZE; q++) {
+            const Vec3i &t = tri[faces[q]];
+            for (int j=0; j<3 && (int)faces.size()-m.first<MESHLET_SIZE; j++) {
+                for (int k=vert_first[t[j]]; k<vert_first[t[j]+1]; k++) {
+                    int f = vert_faces[k];
+                    if (used[f]) continue;
+                    if (!degenerate[seed] && !degenerate[f] && normal[f]*normal[seed]<MESHLET_NORMAL_COS) continue;
+                    used[f] = 1;
+                    faces.push_back(f);
+                    if ((int)faces.size()-m.first==MESHLET_SIZE) break;
+                }
+            }
+        }
+        m.count = (int)faces.size() - m.first;
+
+        // сфера вокруг центра AABB вершин
+        Vec3f lo = model.vert(tri[seed][0]), hi = lo;
+        bool flat = true; // есть вырожденная грань - конус не строим
+        Vec3f sum(0, 0, 0);
+        for (int i=m.first; i<m.first+m.count; i++) {
+            for (int j=0; j<3; j++) {
+                Vec3f v = model.vert(tri[faces[i]][j]);
+                for (int c=0; c<3; c++) {
+                    lo[c] = std::min(lo[c], v[c]);
+                    hi[c] = std::max(hi[c], v[c]);
+                }
+            }
+            flat = flat && !degenerate[faces[i]];
+            sum = sum + normal[faces[i]];
+        }
+        m.lo = lo;
+        m.hi = hi;
+        m.center = (lo + hi)*.5f;
+        m.radius = 0;
+        for (int i=m.first; i<m.first+m.count; i++)
+            for (int j=0; j<3; j++) m.radius = std::max(m.radius, (model.vert(tri[faces[i]][j]) - m.center).norm());
+
+        m.cone_cos = -1;
+        m.axis = Vec3f(0, 0, 1);
+        if (flat && sum.norm()>0) {
+            m.axis = sum.normalize();
+            m.cone_cos = 1;
+            for (int i=m.first; i<m.first+m.count; i++) m.cone_cos = std::min(m.cone_cos, normal[faces[i]]*m.axis);
+        }
+        m.cone_sin = std::sqrt(std::max(0.f, 1 - m.cone_cos*m.cone_cos));
+        meshlets.push_back(m);
+    }
+}
+
+// все грани с нормалью в конусе отвёрнуты от eye в каждой точке сферы:
+// n*(p - eye) > 0. n*(c - eye) не меньше cos*A - sin*P, где A и P - проекции
+// c - eye на ось и на перпендикуляр к ней, а n*(p - c) >= -radius
+static bool cone_backfacing(const Meshlet &m, const Vec3f &axis, const Vec3f &eye) {
+    if (m.cone_cos<=0) return false;
+    Vec3f d = m.center - eye;
+    float a = d*axis;
+    if (a<=0) return false;
+    float p = std::sqrt(std::max(0.f, d*d - a*a));
+    return m.cone_cos*a - m.cone_sin*p > m.radius;
+}
+
+void cull_meshlets(const std::vector<Meshlet> &meshlets, const std::vector<int> &faces,
+                   const Mat4 &transform, int width, int height, const Vec3f &eye, CullMode cull,
+                   std::vector<unsigned char> &visible, MeshletStats &stats) {
+    // плоскости экрана и ближняя в мировых координатах (строки transform):
+    // x >= 0, x <= width, y >= 0, y <= height на экране и w >= NEAR_W, ">= 0" - внутри
+    float plane[5][4];
+    for (int k=0; k<4; k++) {
+        float x = transform[0][k], y = transform[1][k], w = transform[3][k];
+        plane[0][k] = x;
+        plane[1][k] = width*w - x;
+        plane[2][k] = y;
+        plane[3][k] = height*w - y;
+        plane[4][k] = w;
+    }
+    plane[4][3] -= NEAR_W;
+
+    visible.assign(faces.size(), 1);
+    for (size_t i=0; i<meshlets.size(); i++) {
+        const Meshlet &m = meshlets[i];
+        stats.meshlets++;
+
+        bool outside = false;
+        for (int k=0; k<5 && !outside; k++) {
+            float len = std::sqrt(plane[k][0]*plane[k][0] + plane[k][1]*plane[k][1] + plane[k][2]*plane[k][2]);
+            float dist = plane[k][0]*m.center.x + plane[k][1]*m.center.y + plane[k][2]*m.center.z + plane[k][3];
+            outside = dist < -m.radius*len;
+        }
+        bool back = false;
+        if (!outside && cull!=CULL_NONE)
+            back = cone_backfacing(m, cull==CULL_BACK ? m.axis : m.axis*-1.f, eye);
+
+        if (!outside && !back) continue;
+        if (outside) stats.frustum++;
+        else stats.backface++;
+        stats.faces += m.count;
+        for (int j=m.first; j<m.first+m.count; j++) visible[faces[j]] = 0;
+    }
+}
@@ -0,0 +1,46 @@
+// meshlet.h
+#ifndef __MESHLET_H__
+#define __MESHLET_H__
+
+#include <vector>
+#include "geometry.h"
+#include "matrix.h"
+#include "model.h"
+#include "primitive.h"
+
+// мешлет - до MESHLET_SIZE соседних граней с близкими нормалями; целиком
+// отбрасывается по ограничивающей сфере и конусу нормалей до преобразования вершин
+static const int MESHLET_SIZE = 64;
+// грань берётся в мешлет, если косинус между её нормалью и нормалью первой
+// грани не меньше этого: чем уже конус, тем чаще мешлет целиком задний
+static const float MESHLET_NORMAL_COS = 0.7f;
+
+struct Meshlet {
+    int first, count;    // грани faces[first .. first+count)
+    Vec3f lo, hi;        // AABB вершин
+    Vec3f center;        // ограничивающая сфера
+    float radius;
+    Vec3f axis;          // ось конуса внешних нормалей (лицевая сторона - против часовой)
+    float cone_cos, cone_sin; // половина раствора конуса; cone_cos <= 0 - конус не отсекает
+};
+
+struct MeshletStats {
+    long long meshlets; // проверено
+    long long frustum;  // целиком вне экрана или за камерой
+    long long backface; // все грани отбрасываются по ориентации
+    long long faces;    // грани в отброшенных мешлетах
+
+    MeshletStats() : meshlets(0), frustum(0), backface(0), faces(0) {}
+};
+
+// при загрузке: грани model раскладываются по мешлетам обходом в ширину по
+// общим вершинам; faces - номера граней подряд по мешлетам
+void build_meshlets(Model &model, std::vector<Meshlet> &meshlets, std::vector<int> &faces);
+
+// visible[i] = 0 для граней отброшенных мешлетов. transform - ViewPort*Projection*View,
+// экран width x height как у PrimitiveStage; eye - центр проекции (Camera::projection_center)
+void cull_meshlets(const std::vector<Meshlet> &meshlets, const std::vector<int> &faces,
+                   const Mat4 &transform, int width, int height, const Vec3f &eye, CullMode cull,
+                   std::vector<unsigned char> &visible, MeshletStats &stats);
+
+#endif // __MESHLET_H__
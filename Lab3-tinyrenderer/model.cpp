@@ -1,43 +1,401 @@
 #include <iostream>
-#include <string>
 #include <fstream>
-#include <sstream>
+#include <string>
 #include <vector>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cfloat>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "mapfile.h"
+#include "quantize.h"
 #include "model.h"
 
-Model::Model(const char *filename) : verts_(), uv_(), faces_(), faces_uv_(), diffusemap_() {
-    std::ifstream in;
-    in.open (filename, std::ifstream::in);
-    if (in.fail()) return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            Vec3f v;
-            for (int i=0;i<3;i++) iss >> v.raw[i];
-            verts_.push_back(v);
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
+// разбор OBJ: файл отображается в память, режется по строкам на куски, куски
+// разбираются параллельно и склеиваются по порядку
+
+// кусок файла после разбора; индексы граней уже с нуля
+struct ObjChunk {
+    std::vector<float> x, y, z;
+    std::vector<Vec2f> uv;
+    std::vector<Vec3f> norms;
+    std::vector<int> faces, faces_uv, faces_norm;
+    // позиции в faces* с отрицательными (относительными) индексами: они
+    // посчитаны от начала куска, при склейке прибавляется число элементов
+    // из предыдущих кусков
+    std::vector<int> rel_v, rel_vt, rel_vn;
+    long long bad; // строки f, которые не разобрались
+    ObjChunk() : bad(0) {}
+};
+
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p<end && (*p==' ' || *p=='\t')) p++;
+    return p;
+}
+
+static const char *parse_float(const char *p, const char *end, float &v) {
+    p = skip_blanks(p, end);
+    if (p<end && *p=='+') p++;
+    std::from_chars_result r = std::from_chars(p, end, v);
+    return r.ec==std::errc() ? r.ptr : NULL;
+}
+
+static const char *parse_int(const char *p, const char *end, int &v) {
+    if (p<end && *p=='+') p++;
+    std::from_chars_result r = std::from_chars(p, end, v);
+    return r.ec==std::errc() ? r.ptr : NULL;
+}
+
+// индекс OBJ в индекс с нуля: 0 - нет индекса (-1), отрицательный - от
+// конца уже прочитанных элементов куска
+static int resolve(int idx, int count, bool &relative) {
+    relative = idx<0;
+    if (idx>0) return idx-1;
+    if (idx<0) return count + idx;
+    return -1;
+}
+
+// строка f: v, v/vt, v//vn или v/vt/vn у каждого угла, многоугольник - веером
+static void parse_face(const char *p, const char *end, ObjChunk &c) {
+    int v[3], vt[3], vn[3];
+    bool rv[3], rvt[3], rvn[3];
+    int n = 0;
+    for (;;) {
+        p = skip_blanks(p, end);
+        if (p>=end || *p=='\r' || *p=='#') break;
+        int iv = 0, ivt = 0, ivn = 0;
+        p = parse_int(p, end, iv);
+        if (!p || iv==0) { c.bad++; return; }
+        if (p<end && *p=='/') {
+            p++;
+            if (p<end && *p!='/') p = parse_int(p, end, ivt);
+            if (p && p<end && *p=='/') p = parse_int(p+1, end, ivn);
+            if (!p) { c.bad++; return; }
+        }
+        if (p<end && *p!=' ' && *p!='\t' && *p!='\r') { c.bad++; return; }
+
+        // угол 0 остаётся, 1 и 2 сдвигаются: треугольники (0, k-1, k)
+        int k = n<3 ? n : 2;
+        if (n>=3) {
+            v[1] = v[2]; vt[1] = vt[2]; vn[1] = vn[2];
+            rv[1] = rv[2]; rvt[1] = rvt[2]; rvn[1] = rvn[2];
+        }
+        v[k] = resolve(iv, (int)c.x.size(), rv[k]);
+        vt[k] = resolve(ivt, (int)c.uv.size(), rvt[k]);
+        vn[k] = resolve(ivn, (int)c.norms.size(), rvn[k]);
+        if (++n<3) continue;
+
+        for (int j=0; j<3; j++) {
+            int at = (int)c.faces.size();
+            if (rv[j]) c.rel_v.push_back(at);
+            if (rvt[j]) c.rel_vt.push_back(at);
+            if (rvn[j]) c.rel_vn.push_back(at);
+            c.faces.push_back(v[j]);
+            c.faces_uv.push_back(vt[j]);
+            c.faces_norm.push_back(vn[j]);
+        }
+    }
+    if (n<3) c.bad++;
+}
+
+static void parse_chunk(const char *p, const char *end, ObjChunk *c) {
+    while (p<end) {
+        const char *eol = (const char *)memchr(p, '\n', end-p);
+        if (!eol) eol = end;
+        const char *q = skip_blanks(p, eol);
+        if (eol-q>=2 && q[0]=='v' && (q[1]==' ' || q[1]=='\t')) {
+            float v[3] = { 0, 0, 0 };
+            const char *r = q+2;
+            for (int i=0; i<3 && r; i++) r = parse_float(r, eol, v[i]);
+            c->x.push_back(v[0]);
+            c->y.push_back(v[1]);
+            c->z.push_back(v[2]);
+        } else if (eol-q>=3 && q[0]=='v' && q[1]=='t' && (q[2]==' ' || q[2]=='\t')) {
             Vec2f uv;
-            for (int i=0;i<2;i++) iss >> uv.raw[i];
-            uv_.push_back(uv);
-        } else if (!line.compare(0, 2, "f ")) {
-            std::vector<int> f;
-            std::vector<int> f_uv;
-            int v_idx, vt_idx, vn_idx;
-            iss >> trash;
-            while (iss >> v_idx >> trash >> vt_idx >> trash >> vn_idx) {
-                f.push_back(v_idx-1);
-                f_uv.push_back(vt_idx-1);
-            }
-            faces_.push_back(f);
-            faces_uv_.push_back(f_uv);
+            const char *r = q+3;
+            for (int i=0; i<2 && r; i++) r = parse_float(r, eol, uv.raw[i]);
+            c->uv.push_back(uv);
+        } else if (eol-q>=3 && q[0]=='v' && q[1]=='n' && (q[2]==' ' || q[2]=='\t')) {
+            Vec3f n;
+            const char *r = q+3;
+            for (int i=0; i<3 && r; i++) r = parse_float(r, eol, n.raw[i]);
+            c->norms.push_back(n);
+        } else if (eol-q>=2 && q[0]=='f' && (q[1]==' ' || q[1]=='\t')) {
+            parse_face(q+2, eol, *c);
+        }
+        p = eol+1;
+    }
+}
+
+template <class T> static void append(std::vector<T> &dst, const std::vector<T> &src) {
+    dst.insert(dst.end(), src.begin(), src.end());
+}
+
+void Model::parse_obj(const MappedFile &file, int threads) {
+    auto start = std::chrono::steady_clock::now();
+
+    // куски не меньше OBJ_CHUNK байт, границы сдвинуты на начало строки
+    const char *data = file.data(), *end = data + file.size();
+    if (threads<=0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    int nchunks = (int)std::max<size_t>(1, std::min<size_t>(threads, file.size() / OBJ_CHUNK));
+    std::vector<const char *> bounds(nchunks+1, end);
+    bounds[0] = data;
+    for (int i=1; i<nchunks; i++) {
+        const char *p = std::max(bounds[i-1], data + file.size()/nchunks*i);
+        const char *eol = (const char *)memchr(p, '\n', end-p);
+        bounds[i] = eol ? eol+1 : end;
+    }
+    std::vector<ObjChunk> chunks(nchunks);
+    std::vector<std::thread> pool;
+    for (int i=1; i<nchunks; i++) pool.push_back(std::thread(parse_chunk, bounds[i], bounds[i+1], &chunks[i]));
+    parse_chunk(bounds[0], bounds[1], &chunks[0]);
+    for (size_t i=0; i<pool.size(); i++) pool[i].join();
+
+    // склейка по порядку; относительные индексы получают базу куска
+    long long bad = 0;
+    for (int i=0; i<nchunks; i++) {
+        ObjChunk &c = chunks[i];
+        int base_v = (int)x_.size(), base_vt = (int)uv_.size(), base_vn = (int)norms_.size();
+        for (size_t k=0; k<c.rel_v.size(); k++) c.faces[c.rel_v[k]] += base_v;
+        for (size_t k=0; k<c.rel_vt.size(); k++) c.faces_uv[c.rel_vt[k]] += base_vt;
+        for (size_t k=0; k<c.rel_vn.size(); k++) c.faces_norm[c.rel_vn[k]] += base_vn;
+        append(x_, c.x);
+        append(y_, c.y);
+        append(z_, c.z);
+        append(uv_, c.uv);
+        append(norms_, c.norms);
+        append(faces_, c.faces);
+        append(faces_uv_, c.faces_uv);
+        append(faces_norm_, c.faces_norm);
+        bad += c.bad;
+        c = ObjChunk();
+    }
+
+    // треугольник с вершиной вне файла отбрасывается, uv и нормаль вне файла - как отсутствующие
+    int out = 0;
+    for (int i=0; i<(int)faces_.size(); i+=3) {
+        bool ok = true;
+        for (int j=0; j<3; j++) ok = ok && faces_[i+j]>=0 && faces_[i+j]<(int)x_.size();
+        if (!ok) { bad++; continue; }
+        for (int j=0; j<3; j++) {
+            int vt = faces_uv_[i+j], vn = faces_norm_[i+j];
+            faces_[out+j] = faces_[i+j];
+            faces_uv_[out+j] = vt>=0 && vt<(int)uv_.size() ? vt : -1;
+            faces_norm_[out+j] = vn>=0 && vn<(int)norms_.size() ? vn : -1;
         }
+        out += 3;
+    }
+    faces_.resize(out);
+    faces_uv_.resize(out);
+    faces_norm_.resize(out);
+
+    face_normals_.resize(faces_.size()/3);
+    for (size_t i=0; i<face_normals_.size(); i++) {
+        const int *f = &faces_[i*3];
+        Vec3f v0(x_[f[0]], y_[f[0]], z_[f[0]]);
+        Vec3f v1(x_[f[1]], y_[f[1]], z_[f[1]]);
+        Vec3f v2(x_[f[2]], y_[f[2]], z_[f[2]]);
+        Vec3f n = (v2-v0)^(v1-v0);
+        if (n.norm()>0) n.normalize();
+        face_normals_[i] = n;
     }
-    std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << " vt# " << uv_.size() << std::endl;
+
+    mesh_.x = x_.data();
+    mesh_.y = y_.data();
+    mesh_.z = z_.data();
+    mesh_.uv = uv_.data();
+    mesh_.norms = norms_.data();
+    mesh_.faces = faces_.data();
+    mesh_.faces_uv = faces_uv_.data();
+    mesh_.faces_norm = faces_norm_.data();
+    mesh_.face_normals = face_normals_.data();
+    mesh_.nverts = (int)x_.size();
+    mesh_.nuv = (int)uv_.size();
+    mesh_.nnorms = (int)norms_.size();
+    mesh_.nfaces = (int)faces_.size()/3;
+
+    std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+    std::cerr << "# obj: " << file.size()/1024 << " KB in " << ms.count() << " ms, chunks " << nchunks;
+    if (bad) std::cerr << ", bad faces " << bad;
+    std::cerr << std::endl;
+}
+
+// заголовок кэша; за ним массивы MeshArrays по порядку, каждый с границы MESH_CACHE_ALIGN
+struct MeshCacheHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int header_size; // заодно проверка раскладки структуры
+    unsigned long long source_size;
+    long long source_mtime;
+    unsigned long long source_hash;
+    int nverts, nuv, nnorms, nfaces;
+    unsigned long long offset[9]; // x y z uv norms faces faces_uv faces_norm face_normals
+};
+
+static const char MESH_CACHE_MAGIC[8] = { 'T', 'R', 'M', 'E', 'S', 'H', 0, 0 };
+static const size_t MESH_CACHE_ALIGN = 64;
+
+// байты массивов кэша в порядке offset
+static void cache_sizes(int nverts, int nuv, int nnorms, int nfaces, size_t bytes[9]) {
+    for (int i=0; i<3; i++) bytes[i] = sizeof(float)*nverts;
+    bytes[3] = sizeof(Vec2f)*nuv;
+    bytes[4] = sizeof(Vec3f)*nnorms;
+    for (int i=5; i<8; i++) bytes[i] = sizeof(int)*3*nfaces;
+    bytes[8] = sizeof(Vec3f)*nfaces;
+}
+
+// FNV-1a по 8-байтовым словам, хвост по байтам
+static unsigned long long hash_bytes(const char *p, size_t n) {
+    unsigned long long h = 14695981039346656037ULL;
+    const unsigned long long prime = 1099511628211ULL;
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+        unsigned long long w;
+        memcpy(&w, p+i, 8);
+        h = (h ^ w) * prime;
+    }
+    for (; i<n; i++) h = (h ^ (unsigned char)p[i]) * prime;
+    return h;
+}
+
+// индексы в [lo, n); кэш мог испортиться или быть записан другой сборкой
+static bool indices_in_range(const int *idx, int count, int lo, int n) {
+    for (int i=0; i<count; i++)
+        if (idx[i]<lo || idx[i]>=n) return false;
+    return true;
+}
+
+bool Model::load_cache(const char *name, const MappedFile &source, bool &stale) {
+    stale = false;
+    if (!cache_.open(name)) return false;
+    MeshCacheHeader h;
+    bool ok = cache_.size()>=sizeof(h);
+    if (ok) memcpy(&h, cache_.data(), sizeof(h));
+    ok = ok && !memcmp(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic)) && h.version==MESH_CACHE_VERSION
+            && h.header_size==sizeof(h) && h.source_size==source.size()
+            && h.nverts>=0 && h.nuv>=0 && h.nnorms>=0 && h.nfaces>=0;
+    size_t bytes[9];
+    if (ok) cache_sizes(h.nverts, h.nuv, h.nnorms, h.nfaces, bytes);
+    for (int i=0; ok && i<9; i++)
+        ok = h.offset[i]%MESH_CACHE_ALIGN==0 && h.offset[i]<=cache_.size() && bytes[i]<=cache_.size()-h.offset[i];
+    // OBJ целиком хэшируется, только если у него другое время записи (копия, checkout):
+    // при совпадении хэша кэш годен, но stale - время в заголовке надо обновить
+    if (ok && h.source_mtime!=source.mtime()) {
+        ok = h.source_hash==hash_bytes(source.data(), source.size());
+        stale = ok;
+    }
+
+    const char *base = cache_.data();
+    if (ok) {
+        const int n = h.nfaces*3;
+        ok = indices_in_range((const int *)(base + h.offset[5]), n, 0, h.nverts)
+          && indices_in_range((const int *)(base + h.offset[6]), n, -1, h.nuv)
+          && indices_in_range((const int *)(base + h.offset[7]), n, -1, h.nnorms);
+    }
+    if (!ok) {
+        cache_.close();
+        return false;
+    }
+
+    mesh_.x = (const float *)(base + h.offset[0]);
+    mesh_.y = (const float *)(base + h.offset[1]);
+    mesh_.z = (const float *)(base + h.offset[2]);
+    mesh_.uv = (const Vec2f *)(base + h.offset[3]);
+    mesh_.norms = (const Vec3f *)(base + h.offset[4]);
+    mesh_.faces = (const int *)(base + h.offset[5]);
+    mesh_.faces_uv = (const int *)(base + h.offset[6]);
+    mesh_.faces_norm = (const int *)(base + h.offset[7]);
+    mesh_.face_normals = (const Vec3f *)(base + h.offset[8]);
+    mesh_.nverts = h.nverts;
+    mesh_.nuv = h.nuv;
+    mesh_.nnorms = h.nnorms;
+    mesh_.nfaces = h.nfaces;
+    return true;
+}
+
+// пишется во временный файл и переименовывается, чтобы другой процесс не отобразил половину.
+// кэш - только ускорение: если записать не вышло (каталог только для чтения), молча без него.
+// Массивы могут лежать в отображении старого кэша: оно закрывается только перед заменой
+// файла (в Windows отображённый файл не удалить и не заменить), mesh_ после этого надо
+// взять заново. true - файл заменён
+bool Model::write_cache(const char *name, const MappedFile &source) {
+    MeshCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MESH_CACHE_MAGIC, sizeof(h.magic));
+    h.version = MESH_CACHE_VERSION;
+    h.header_size = sizeof(h);
+    h.source_size = source.size();
+    h.source_mtime = source.mtime();
+    h.source_hash = hash_bytes(source.data(), source.size());
+    h.nverts = mesh_.nverts;
+    h.nuv = mesh_.nuv;
+    h.nnorms = mesh_.nnorms;
+    h.nfaces = mesh_.nfaces;
+
+    const void *arrays[9] = { mesh_.x, mesh_.y, mesh_.z, mesh_.uv, mesh_.norms,
+                              mesh_.faces, mesh_.faces_uv, mesh_.faces_norm, mesh_.face_normals };
+    size_t bytes[9];
+    cache_sizes(h.nverts, h.nuv, h.nnorms, h.nfaces, bytes);
+    size_t at = sizeof(h);
+    for (int i=0; i<9; i++) {
+        at = (at + MESH_CACHE_ALIGN-1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN;
+        h.offset[i] = at;
+        at += bytes[i];
+    }
+
+    std::string tmp = std::string(name) + ".tmp";
+    std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    static const char zeros[MESH_CACHE_ALIGN] = { 0 };
+    out.write((const char *)&h, sizeof(h));
+    at = sizeof(h);
+    for (int i=0; i<9; i++) {
+        out.write(zeros, h.offset[i] - at);
+        if (bytes[i]) out.write((const char *)arrays[i], bytes[i]);
+        at = h.offset[i] + bytes[i];
+    }
+    out.close();
+    if (!out) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    cache_.close();
+#ifdef _WIN32
+    std::remove(name); // rename в Windows не заменяет существующий файл
+#endif
+    if (std::rename(tmp.c_str(), name)!=0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+Model::Model(const char *filename, int threads, bool cache) : mesh_(), x_(), y_(), z_(), uv_(), norms_(), faces_(),
+    faces_uv_(), faces_norm_(), face_normals_(), cache_(), compact_(false), qx_(), qy_(), qz_(), quv_(),
+    qnorms_(), qface_normals_(), diffusemap_() {
+    MappedFile source;
+    if (!source.open(filename)) return;
+
+    auto start = std::chrono::steady_clock::now();
+    std::string cache_name = std::string(filename) + MESH_CACHE_SUFFIX;
+    bool stale = false;
+    bool cached = cache && load_cache(cache_name.c_str(), source, stale);
+    // другое время записи при том же содержимом: кэш переписывается с новым временем
+    // тем же путём через временный файл и отображается заново; не вышло - он ещё открыт
+    bool refreshed = cached && stale && write_cache(cache_name.c_str(), source);
+    if (refreshed) cached = load_cache(cache_name.c_str(), source, stale);
+    if (cached) {
+        std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+        std::cerr << "# mesh cache: " << cache_name << ", " << cache_.size()/1024 << " KB mapped in "
+                  << ms.count() << " ms" << (refreshed ? ", source time refreshed" : "") << std::endl;
+    } else {
+        parse_obj(source, threads);
+        if (cache) write_cache(cache_name.c_str(), source);
+    }
+    std::cerr << "# v# " << nverts() << " f# "  << nfaces() << " vt# " << mesh_.nuv << std::endl;
     load_texture(filename, "_diffuse.tga", diffusemap_);
 }
 
@@ -45,27 +403,134 @@ Model::~Model() {
 }
 
 int Model::nverts() {
-    return (int)verts_.size();
+    return mesh_.nverts;
 }
 
 int Model::nfaces() {
-    return (int)faces_.size();
+    return mesh_.nfaces;
 }
 
-std::vector<int> Model::face(int idx) {
-    return faces_[idx];
+Vec3f Model::vert(int i) {
+    if (compact_)
+        return Vec3f(dequantize16(qx_[i], qlo_.x, qstep_.x), dequantize16(qy_[i], qlo_.y, qstep_.y),
+                     dequantize16(qz_[i], qlo_.z, qstep_.z));
+    return Vec3f(mesh_.x[i], mesh_.y[i], mesh_.z[i]);
 }
 
-std::vector<int> Model::face_uv(int idx) {
-    return faces_uv_[idx];
+Vec2f Model::uv(int i) {
+    if (i<0) return Vec2f(0, 0);
+    if (compact_) return Vec2f(dequantize16(quv_[i*2], uvlo_.x, uvstep_.x), dequantize16(quv_[i*2+1], uvlo_.y, uvstep_.y));
+    return mesh_.uv[i];
 }
 
-Vec3f Model::vert(int i) {
-    return verts_[i];
+Vec3f Model::normal(int iface, int nthvert) {
+    int i = mesh_.faces_norm[iface*3+nthvert];
+    if (i<0) return face_normal(iface)*-1.f; // face_normal смотрит внутрь, vn - наружу
+    return compact_ ? oct_decode(qnorms_[i]) : mesh_.norms[i];
 }
 
-Vec2f Model::uv(int i) {
-    return uv_[i];
+Vec3f Model::face_normal(int iface) {
+    return compact_ ? oct_decode(qface_normals_[iface]) : mesh_.face_normals[iface];
+}
+
+QuantizedPositions Model::quantized() {
+    QuantizedPositions q = { qx_.data(), qy_.data(), qz_.data(), qlo_, qstep_, mesh_.nverts };
+    return q;
+}
+
+CompactStats Model::compact() {
+    CompactStats st;
+    memset(&st, 0, sizeof(st));
+    if (compact_) return st;
+    int nverts = mesh_.nverts, nuv = mesh_.nuv, nnorms = mesh_.nnorms, nfaces = mesh_.nfaces;
+
+    // границы модели и uv
+    Vec3f lo(0, 0, 0), hi(0, 0, 0);
+    for (int i=0; i<nverts; i++) {
+        Vec3f v = vert(i);
+        for (int k=0; k<3; k++) {
+            lo.raw[k] = i ? std::min(lo.raw[k], v.raw[k]) : v.raw[k];
+            hi.raw[k] = i ? std::max(hi.raw[k], v.raw[k]) : v.raw[k];
+        }
+    }
+    Vec2f uvlo(0, 0), uvhi(0, 0);
+    for (int i=0; i<nuv; i++)
+        for (int k=0; k<2; k++) {
+            uvlo.raw[k] = i ? std::min(uvlo.raw[k], mesh_.uv[i].raw[k]) : mesh_.uv[i].raw[k];
+            uvhi.raw[k] = i ? std::max(uvhi.raw[k], mesh_.uv[i].raw[k]) : mesh_.uv[i].raw[k];
+        }
+    qlo_ = lo;
+    qstep_ = Vec3f(quant_step(lo.x, hi.x), quant_step(lo.y, hi.y), quant_step(lo.z, hi.z));
+    uvlo_ = uvlo;
+    uvstep_ = Vec2f(quant_step(uvlo.x, uvhi.x), quant_step(uvlo.y, uvhi.y));
+
+    // хвост до кратного 8 - нули, для пакетов Float8
+    int padded = (nverts+7) & ~7;
+    qx_.assign(padded, 0);
+    qy_.assign(padded, 0);
+    qz_.assign(padded, 0);
+    for (int i=0; i<nverts; i++) {
+        Vec3f v = vert(i);
+        qx_[i] = quantize16(v.x, lo.x, qstep_.x);
+        qy_[i] = quantize16(v.y, lo.y, qstep_.y);
+        qz_[i] = quantize16(v.z, lo.z, qstep_.z);
+        Vec3f d(dequantize16(qx_[i], lo.x, qstep_.x), dequantize16(qy_[i], lo.y, qstep_.y),
+                dequantize16(qz_[i], lo.z, qstep_.z));
+        for (int k=0; k<3; k++) st.position_error = std::max(st.position_error, std::fabs(d.raw[k]-v.raw[k]));
+    }
+    quv_.resize(nuv*2);
+    for (int i=0; i<nuv; i++)
+        for (int k=0; k<2; k++) {
+            float v = mesh_.uv[i].raw[k];
+            quv_[i*2+k] = quantize16(v, uvlo.raw[k], uvstep_.raw[k]);
+            st.uv_error = std::max(st.uv_error, std::fabs(dequantize16(quv_[i*2+k], uvlo.raw[k], uvstep_.raw[k])-v));
+        }
+
+    // угол между исходной нормированной нормалью и декодированной; через atan2,
+    // у acos около 1 разрешение float хуже самой ошибки
+    float max_angle = 0;
+    qnorms_.resize(nnorms);
+    for (int i=0; i<nnorms; i++) {
+        Vec3f n = mesh_.norms[i];
+        if (n.norm()>0) n.normalize();
+        qnorms_[i] = oct_encode(n);
+        Vec3f d = oct_decode(qnorms_[i]);
+        if (n.norm()>0) max_angle = std::max(max_angle, std::atan2((d^n).norm(), d*n));
+    }
+    qface_normals_.resize(nfaces);
+    for (int i=0; i<nfaces; i++) {
+        Vec3f n = mesh_.face_normals[i];
+        qface_normals_[i] = oct_encode(n);
+        Vec3f d = oct_decode(qface_normals_[i]);
+        if (n.norm()>0) max_angle = std::max(max_angle, std::atan2((d^n).norm(), d*n));
+    }
+    static const float PI = 3.14159265f; // M_PI не из стандарта, в MSVC его нет без _USE_MATH_DEFINES
+    st.normal_error = max_angle * 180.f / PI;
+    // полшага сетки и округление float в lo + q*step
+    for (int k=0; k<3; k++)
+        st.position_bound = std::max(st.position_bound,
+                                     qstep_.raw[k]*.5f + (std::fabs(lo.raw[k])+std::fabs(hi.raw[k]))*FLT_EPSILON);
+    for (int k=0; k<2; k++)
+        st.uv_bound = std::max(st.uv_bound,
+                               uvstep_.raw[k]*.5f + (std::fabs(uvlo.raw[k])+std::fabs(uvhi.raw[k]))*FLT_EPSILON);
+
+    st.bytes_before = (long long)nverts*3*sizeof(float) + (long long)nuv*sizeof(Vec2f)
+                    + (long long)(nnorms + nfaces)*sizeof(Vec3f);
+    st.bytes_after = (long long)padded*3*sizeof(unsigned short) + (long long)nuv*2*sizeof(unsigned short)
+                   + (long long)(nnorms + nfaces)*sizeof(unsigned int);
+
+    // float-данные больше не нужны; страницы кэша, если модель из него, просто не читаются
+    compact_ = true;
+    mesh_.x = mesh_.y = mesh_.z = NULL;
+    mesh_.uv = NULL;
+    mesh_.norms = mesh_.face_normals = NULL;
+    std::vector<float>().swap(x_);
+    std::vector<float>().swap(y_);
+    std::vector<float>().swap(z_);
+    std::vector<Vec2f>().swap(uv_);
+    std::vector<Vec3f>().swap(norms_);
+    std::vector<Vec3f>().swap(face_normals_);
+    return st;
 }
 
 void Model::load_texture(std::string filename, const char *suffix, TGAImage &img) {
@@ -82,4 +547,12 @@ void Model::load_texture(std::string filename, const char *suffix, TGAImage &img
 TGAColor Model::diffuse(Vec2f uvf) {
     Vec2i uv(uvf.x * diffusemap_.get_width(), uvf.y * diffusemap_.get_height());
     return diffusemap_.get(uv.x, uv.y);
+}
+
+int Model::diffuse_width() {
+    return diffusemap_.get_width();
+}
+
+int Model::diffuse_height() {
+    return diffusemap_.get_height();
 }
\ No newline at end of file
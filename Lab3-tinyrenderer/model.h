@@ -4,29 +4,113 @@
 #include <vector>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "mapfile.h"
+
+// непрерывный кусок массива модели, без копирования; действителен, пока жива модель
+template <class T> struct Span {
+    const T *data;
+    int size;
+
+    Span(const T *d, int n) : data(d), size(n) {}
+    const T &operator[](int i) const { return data[i]; }
+    const T *begin() const { return data; }
+    const T *end() const { return data + size; }
+};
+
+// OBJ меньше стольких байт на поток разбирается одним потоком
+static const size_t OBJ_CHUNK = 1 << 20;
+
+// двоичный кэш разобранной модели лежит рядом с OBJ: <файл.obj>.meshcache
+static const char MESH_CACHE_SUFFIX[] = ".meshcache";
+static const unsigned int MESH_CACHE_VERSION = 1;
+
+// массивы модели; указывают в свои векторы после разбора OBJ или прямо в отображённый кэш
+struct MeshArrays {
+    const float *x, *y, *z; // позиции структурой массивов
+    const Vec2f *uv; // текстурные координаты
+    const Vec3f *norms; // нормали vn
+    // грани разбиты на треугольники при загрузке, по 3 индекса подряд
+    const int *faces; // индексы вершин v
+    const int *faces_uv; // Индексы текстур vt (параллельно faces)
+    const int *faces_norm; // индексы нормалей vn (параллельно faces)
+    const Vec3f *face_normals; // нормаль треугольника, нулевая у вырожденного
+    int nverts, nuv, nnorms, nfaces;
+
+    MeshArrays() : x(NULL), y(NULL), z(NULL), uv(NULL), norms(NULL), faces(NULL), faces_uv(NULL),
+        faces_norm(NULL), face_normals(NULL), nverts(0), nuv(0), nnorms(0), nfaces(0) {}
+};
+
+// компактные позиции: v = lo + q*step по каждой оси, длина массивов кратна 8
+struct QuantizedPositions {
+    const unsigned short *x, *y, *z;
+    Vec3f lo, step;
+    int size;
+};
+
+// итоги Model::compact(); ошибки - наибольшие по модели, границы - полшага сетки
+// с округлением float при декодировании
+struct CompactStats {
+    float position_error, position_bound; // по оси, в единицах модели
+    float uv_error, uv_bound;
+    float normal_error; // угол, градусы
+    long long bytes_before, bytes_after; // вершины, uv, нормали и нормали граней
+};
 
 class Model {
 private:
-    std::vector<Vec3f> verts_;
-    std::vector<Vec2f> uv_; // текстурные координаты
-    
-    std::vector<std::vector<int> > faces_; // индексы вершин v
-    std::vector<std::vector<int> > faces_uv_; // Индексы текстур vt (параллельно faces_)
-    
+    MeshArrays mesh_;
+
+    // данные после разбора OBJ; пустые, если модель взята из кэша
+    std::vector<float> x_, y_, z_;
+    std::vector<Vec2f> uv_;
+    std::vector<Vec3f> norms_;
+    std::vector<int> faces_, faces_uv_, faces_norm_;
+    std::vector<Vec3f> face_normals_;
+    MappedFile cache_; // отображённый кэш, на него указывает mesh_
+
+    // компактный режим: позиции и uv 16 бит внутри своих границ, нормали октаэдром
+    bool compact_;
+    std::vector<unsigned short> qx_, qy_, qz_;
+    Vec3f qlo_, qstep_;
+    std::vector<unsigned short> quv_; // u, v подряд
+    Vec2f uvlo_, uvstep_;
+    std::vector<unsigned int> qnorms_, qface_normals_;
+
     TGAImage diffusemap_; //картинка текстуры
 
     void load_texture(std::string filename, const char *suffix, TGAImage &img);
+    void parse_obj(const MappedFile &source, int threads);
+    bool load_cache(const char *name, const MappedFile &source, bool &stale);
+    bool write_cache(const char *name, const MappedFile &source);
 
 public:
-    Model(const char *filename);
+    // v, vt, vn и f с углами v, v/vt, v//vn, v/vt/vn; threads 0 - по числу ядер.
+    // С cache модель берётся из кэша, если у OBJ тот же размер и то же время записи
+    // (или, при другом времени, тот же хэш), иначе OBJ разбирается и кэш переписывается
+    Model(const char *filename, int threads=0, bool cache=true);
     ~Model();
+    // перевести позиции, uv и нормали в компактный вид, float-копии освобождаются;
+    // vert(), uv(), normal() и face_normal() дальше декодируют на лету
+    CompactStats compact();
+    bool is_compact() { return compact_; }
+    QuantizedPositions quantized(); // только в компактном режиме
     int nverts();
     int nfaces();
     Vec3f vert(int i);
-    Vec2f uv(int i); //получить UV по индексу
+    // позиции float, только без компактного режима
+    Span<float> xs() { return Span<float>(mesh_.x, mesh_.nverts); }
+    Span<float> ys() { return Span<float>(mesh_.y, mesh_.nverts); }
+    Span<float> zs() { return Span<float>(mesh_.z, mesh_.nverts); }
+    Vec2f uv(int i); //получить UV по индексу; -1 (у грани нет vt) - (0, 0)
+    Vec3f normal(int iface, int nthvert); // нормаль вершины грани, без vn - нормаль грани
+    // (v2-v0)^(v1-v0), нормированная; считается один раз при загрузке
+    Vec3f face_normal(int iface);
     TGAColor diffuse(Vec2f uv); // получить цвет пикселя по UV координате
-    std::vector<int> face(int idx);
-    std::vector<int> face_uv(int idx); // получить индексы UV для грани
+    int diffuse_width();  // размер текстуры в текселях
+    int diffuse_height();
+    Span<int> face(int idx) { return Span<int>(mesh_.faces + idx*3, 3); }
+    Span<int> face_uv(int idx) { return Span<int>(mesh_.faces_uv + idx*3, 3); } // получить индексы UV для грани
+    Span<int> indices() { return Span<int>(mesh_.faces, mesh_.nfaces*3); } // все треугольники подряд
 };
 
 #endif //__MODEL_H__
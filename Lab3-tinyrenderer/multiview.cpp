@@ -0,0 +1,64 @@
+#include <atomic>
+#include <thread>
+#include "multiview.h"
+
+void setup_mesh(Model &model, const Vec3f &light_dir, MeshSetup &mesh) {
+    int nfaces = model.nfaces();
+    load_positions(model, mesh.positions);
+
+    mesh.faces.resize(nfaces);
+    mesh.uvs.resize(nfaces*3);
+    mesh.intensity.resize(nfaces);
+    for (int i=0; i<nfaces; i++) {
+        Span<int> face = model.face(i);
+        Span<int> face_uv = model.face_uv(i);
+        mesh.faces[i] = Vec3i(face[0], face[1], face[2]);
+        for (int j=0; j<3; j++) mesh.uvs[i*3+j] = model.uv(face_uv[j]);
+        mesh.intensity[i] = std::max(0.f, model.face_normal(i)*light_dir);
+    }
+}
+
+// один вид в image; screen и tris - рабочие буферы потока
+static void render_view(const MeshSetup &mesh, Model &model, const Camera &camera, const Mat4 &viewport,
+                        const ViewOptions &opt, Rasterizer &rasterizer, TGAImage &image,
+                        VertexBuffer &screen, std::vector<RasterTriangle> &tris) {
+    transform_vertices(mesh.positions, camera.mvp(viewport), rasterizer.threads(), screen);
+
+    PrimitiveStage primitives(image.get_width(), image.get_height());
+    primitives.set_cull(opt.cull);
+    tris.clear();
+    for (int i=0; i<(int)mesh.faces.size(); i++) {
+        ClipVertex v[3];
+        for (int j=0; j<3; j++) v[j] = ClipVertex(screen.at(mesh.faces[i][j]), mesh.uvs[i*3+j]);
+        primitives.add(v, mesh.intensity[i], tris);
+    }
+
+    rasterizer.clear();
+    rasterizer.draw(tris, model, image);
+}
+
+void render_views(const MeshSetup &mesh, Model &model, const std::vector<Camera> &cameras,
+                  const Mat4 &viewport, const ViewOptions &opt, std::vector<TGAImage> &images) {
+    int nviews = (int)cameras.size();
+    if (nviews==0) return;
+    int threads = opt.threads>0 ? opt.threads : std::max(1, (int)std::thread::hardware_concurrency());
+    int workers = std::min(threads, nviews);
+    int tile_threads = std::max(1, threads / workers);
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        Rasterizer rasterizer(images[0].get_width(), images[0].get_height());
+        rasterizer.set_threads(tile_threads);
+        rasterizer.set_mode(opt.mode);
+        rasterizer.set_depth_format(opt.depth, 0.f, opt.zfar);
+        VertexBuffer screen;
+        std::vector<RasterTriangle> tris;
+        for (int i = next++; i<nviews; i = next++)
+            render_view(mesh, model, cameras[i], viewport, opt, rasterizer, images[i], screen, tris);
+    };
+
+    std::vector<std::thread> pool;
+    for (int i=1; i<workers; i++) pool.push_back(std::thread(worker));
+    worker();
+    for (size_t i=0; i<pool.size(); i++) pool[i].join();
+}
@@ -0,0 +1,42 @@
+// multiview.h
+#ifndef __MULTIVIEW_H__
+#define __MULTIVIEW_H__
+
+#include <vector>
+#include "geometry.h"
+#include "matrix.h"
+#include "model.h"
+#include "camera.h"
+#include "rasterizer.h"
+#include "primitive.h"
+#include "vertex.h"
+
+// всё, что не зависит от камеры: считается один раз на модель
+struct MeshSetup {
+    VertexBuffer positions;       // вершины модели с w=1
+    std::vector<Vec3i> faces;     // индексы вершин грани
+    std::vector<Vec2f> uvs;       // по 3 на грань
+    std::vector<float> intensity; // освещённость грани, свет задан в мировых координатах
+};
+
+void setup_mesh(Model &model, const Vec3f &light_dir, MeshSetup &mesh);
+
+struct ViewOptions {
+    RasterMode mode;
+    CullMode cull;
+    DepthFormat depth;
+    float zfar;  // диапазон глубины для 16/24 бит
+    int threads; // всего на все виды, 0 - по числу ядер
+
+    ViewOptions() : mode(RASTER_EDGE), cull(CULL_BACK), depth(DEPTH_32F), zfar(255.f), threads(0) {}
+};
+
+// images[i] - вид из cameras[i]. На вид: вершинная стадия transform_vertices
+// (каждая вершина один раз пакетами, а не на каждый угол грани), PrimitiveStage,
+// растеризация. Виды раздаются
+// потокам, у каждого потока свой Rasterizer; если видов меньше потоков,
+// лишние потоки уходят на тайлы внутри вида
+void render_views(const MeshSetup &mesh, Model &model, const std::vector<Camera> &cameras,
+                  const Mat4 &viewport, const ViewOptions &opt, std::vector<TGAImage> &images);
+
+#endif // __MULTIVIEW_H__
@@ -0,0 +1,292 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "occlusion.h"
+#include "simd.h"
+
+OcclusionBuffer::OcclusionBuffer(int width, int height) : width_(width), height_(height),
+    stride_((width+7) & ~7), depth_(stride_*height, 0.f) {
+    for (int i=0; i<16; i++) m_[i] = i%5==0 ? 1.f : 0.f;
+}
+
+void OcclusionBuffer::set_transform(const float m[16]) {
+    memcpy(m_, m, sizeof(m_));
+}
+
+void OcclusionBuffer::clear() {
+    std::fill(depth_.begin(), depth_.end(), 0.f);
+    stats_ = OcclusionStats();
+}
+
+void OcclusionBuffer::project(const float *p, float out[3]) const {
+    for (int r=0, k=0; r<4; r++) {
+        if (r==2) continue; // z не нужен
+        out[k++] = m_[r*4]*p[0] + m_[r*4+1]*p[1] + m_[r*4+2]*p[2] + m_[r*4+3];
+    }
+}
+
+// вершины дальше этого за краем буфера не берутся: на больших координатах float
+// теряет доли пикселя, а контур должен ложиться точно
+static const float OCCLUSION_GUARD = 4096.f;
+// запас контура в пикселях на округление координат
+static const float OCCLUSION_EDGE_EPS = 1.f/64;
+// запас глубины на округление плоскости 1/w
+static const float OCCLUSION_DEPTH_EPS = 1e-5f;
+
+void OcclusionBuffer::add_occluders(const float *verts, int stride, const unsigned int *indices, int ntris) {
+    const char *base = (const char *)verts;
+    tris_.clear();
+    welds_.clear();
+    for (int i=0; i<ntris; i++) {
+        const float *p[3];
+        float c[3][3];
+        for (int j=0; j<3; j++) {
+            unsigned int v = indices ? indices[i*3+j] : (unsigned int)(i*3+j);
+            p[j] = (const float *)(base + (size_t)v*stride);
+            project(p[j], c[j]);
+        }
+        Triangle t;
+        if (!setup(c, t)) { stats_.skipped++; continue; }
+        for (int j=0; j<3; j++) {
+            Weld w;
+            memcpy(w.key, p[j], sizeof(w.key));
+            w.corner = (int)tris_.size()*3 + j;
+            welds_.push_back(w);
+        }
+        tris_.push_back(t);
+    }
+    stats_.occluders += tris_.size();
+    if (tris_.empty()) return;
+
+    // сшивка: одинаковые координаты - одна вершина, как бы ни были заданы индексы
+    std::sort(welds_.begin(), welds_.end());
+    ids_.resize(welds_.size());
+    for (size_t i=0, id=0; i<welds_.size(); i++) {
+        if (i && welds_[i-1]<welds_[i]) id++;
+        ids_[welds_[i].corner] = (int)id;
+    }
+    edges_.clear();
+    for (int i=0; i<(int)tris_.size(); i++)
+        for (int j=0; j<3; j++) {
+            int a = ids_[i*3+j], b = ids_[i*3+(j+1)%3];
+            Edge e = { tris_[i].side, std::min(a, b), std::max(a, b), a<b, i, j };
+            edges_.push_back(e);
+        }
+    // внутреннее ребро - ровно два треугольника одной стороны, обходящие его
+    // навстречу друг другу: тогда они лежат по разные стороны от ребра.
+    // Внутренние рёбра склеивают треугольники в куски, каждый кусок растеризуется
+    // отдельно: иначе контур и глубина заднего куска портят пиксели переднего
+    std::sort(edges_.begin(), edges_.end());
+    parent_.resize(tris_.size());
+    for (size_t i=0; i<parent_.size(); i++) parent_[i] = (int)i;
+    outline_.clear();
+    for (size_t i=0, n; i<edges_.size(); i+=n) {
+        for (n=1; i+n<edges_.size() && !(edges_[i]<edges_[i+n]); n++);
+        if (n==2 && edges_[i].forward!=edges_[i+1].forward)
+            parent_[root(edges_[i].tri)] = root(edges_[i+1].tri);
+        else
+            outline_.push_back(edges_[i]);
+    }
+    order_.resize(tris_.size());
+    for (size_t i=0; i<tris_.size(); i++) {
+        tris_[i].group = root((int)i);
+        order_[i] = (int)i;
+    }
+    std::sort(order_.begin(), order_.end(), ByGroup(tris_));
+    std::sort(outline_.begin(), outline_.end(), ByGroup(tris_));
+
+    for (size_t i=0, j=0, n; i<order_.size(); i+=n) {
+        int group = tris_[order_[i]].group;
+        for (n=1; i+n<order_.size() && tris_[order_[i+n]].group==group; n++);
+        size_t k = j;
+        while (k<outline_.size() && tris_[outline_[k].tri].group==group) k++;
+        rasterize(&order_[i], (int)n, outline_.data() + j, (int)(k - j));
+        j = k;
+    }
+}
+
+int OcclusionBuffer::root(int t) {
+    while (parent_[t]!=t) t = parent_[t] = parent_[parent_[t]];
+    return t;
+}
+
+bool OcclusionBuffer::setup(const float clip[3][3], Triangle &t) const {
+    for (int i=0; i<3; i++) {
+        // за ближней плоскостью не режем: без окклюдера проверка остаётся консервативной
+        if (!(clip[i][2]>=OCCLUSION_NEAR_W)) return false;
+        t.iw[i] = 1.f / clip[i][2];
+        t.sx[i] = (clip[i][0]*t.iw[i]*.5f + .5f) * width_;
+        t.sy[i] = (clip[i][1]*t.iw[i]*.5f + .5f) * height_;
+        if (!(std::fabs(t.sx[i] - .5f*width_)  <= OCCLUSION_GUARD + width_) ||
+            !(std::fabs(t.sy[i] - .5f*height_) <= OCCLUSION_GUARD + height_)) return false;
+    }
+    float area = (t.sx[1]-t.sx[0])*(t.sy[2]-t.sy[0]) - (t.sy[1]-t.sy[0])*(t.sx[2]-t.sx[0]);
+    if (std::fabs(area)<1e-6f) return false;
+    t.side = area>0 ? 0 : 1;
+    return true;
+}
+
+// один кусок: ntris треугольников order и nedges рёбер его контура
+void OcclusionBuffer::rasterize(const int *order, int ntris, const Edge *edges, int nedges) {
+    float xmin = 1e30f, ymin = 1e30f, xmax = -1e30f, ymax = -1e30f;
+    for (int i=0; i<ntris; i++) {
+        const Triangle &t = tris_[order[i]];
+        for (int j=0; j<3; j++) {
+            xmin = std::min(xmin, t.sx[j]);
+            ymin = std::min(ymin, t.sy[j]);
+            xmax = std::max(xmax, t.sx[j]);
+            ymax = std::max(ymax, t.sy[j]);
+        }
+    }
+    // с пикселем запаса на контур; x0 кратно 8
+    int x0 = std::max(0, (int)std::floor(xmin) - 1) & ~7, x1 = std::min(width_-1,  (int)std::floor(xmax) + 1);
+    int y0 = std::max(0, (int)std::floor(ymin) - 1),      y1 = std::min(height_-1, (int)std::floor(ymax) + 1);
+    if (x0>x1 || y0>y1) return;
+    if (cover_.size()!=depth_.size()) {
+        cover_.resize(depth_.size());
+        zmin_.resize(depth_.size());
+        edge_.resize(depth_.size());
+    }
+    for (int y=y0; y<=y1; y++) {
+        std::fill(&cover_[y*stride_ + x0], &cover_[y*stride_] + x1 + 1, 0.f);
+        std::fill(&zmin_[y*stride_ + x0],  &zmin_[y*stride_] + x1 + 1, 1e30f);
+        std::fill(&edge_[y*stride_ + x0],  &edge_[y*stride_] + x1 + 1, 0);
+    }
+    for (int i=0; i<ntris; i++)
+        triangle(tris_[order[i]], y0, y1);
+    for (int i=0; i<nedges; i++) {
+        const Edge &e = edges[i];
+        const Triangle &t = tris_[e.tri];
+        int k = (e.corner+1)%3;
+        outline(t.sx[e.corner], t.sy[e.corner], t.sx[k], t.sy[k], x0, y0, x1, y1);
+    }
+    for (int y=y0; y<=y1; y++)
+        for (int x=x0; x<=x1; x++) {
+            int i = y*stride_ + x;
+            if (cover_[i]==0 || edge_[i]) continue;
+            depth_[i] = std::max(depth_[i], zmin_[i]*(1.f - OCCLUSION_DEPTH_EPS));
+        }
+}
+
+void OcclusionBuffer::triangle(const Triangle &t, int ymin, int ymax) {
+    const float *sx = t.sx, *sy = t.sy, *iw = t.iw;
+    float sign = t.side ? -1.f : 1.f;
+    int xmin = std::max(0, (int)std::floor(std::min(sx[0], std::min(sx[1], sx[2]))));
+    int xmax = std::min(width_-1, (int)std::floor(std::max(sx[0], std::max(sx[1], sx[2]))));
+    ymin = std::max(ymin, (int)std::floor(std::min(sy[0], std::min(sy[1], sy[2]))));
+    ymax = std::min(ymax, (int)std::floor(std::max(sy[0], std::max(sy[1], sy[2]))));
+    if (xmin>xmax || ymin>ymax) return;
+
+    // e_i = a_i*x + b_i*y + c_i - ребро напротив вершины i в центре пикселя (x, y);
+    // e_i + touch_i - то же в самом внутреннем углу пикселя
+    float ea[3], eb[3], ec[3], touch[3];
+    for (int i=0; i<3; i++) {
+        int p = (i+1)%3, q = (i+2)%3;
+        ea[i] = sign * (sy[p] - sy[q]);
+        eb[i] = sign * (sx[q] - sx[p]);
+        ec[i] = sign * (sx[p]*sy[q] - sy[p]*sx[q]) + .5f*(ea[i] + eb[i]);
+        touch[i] = .5f*(std::fabs(ea[i]) + std::fabs(eb[i]));
+    }
+    // 1/w линейна по экрану; самое дальнее значение в пикселе - на полшага
+    // по каждой оси от центра, но не дальше самой дальней вершины
+    float area = (sx[1]-sx[0])*(sy[2]-sy[0]) - (sy[1]-sy[0])*(sx[2]-sx[0]);
+    float inv_area = 1.f / (sign*area);
+    float za = 0, zb = 0, zc = 0;
+    for (int i=0; i<3; i++) {
+        za += iw[i]*ea[i]*inv_area;
+        zb += iw[i]*eb[i]*inv_area;
+        zc += iw[i]*ec[i]*inv_area;
+    }
+    zc -= .5f*(std::fabs(za) + std::fabs(zb));
+    float zfar = std::min(iw[0], std::min(iw[1], iw[2]));
+
+    int x0 = xmin & ~7;
+    Float8 ramp = Float8::ramp();
+    Float8 zero(0.f), one(1.f), none(1e30f), zfar8(zfar);
+    for (int y=ymin; y<=ymax; y++) {
+        float *crow = &cover_[y*stride_], *zrow = &zmin_[y*stride_], *drow = &depth_[y*stride_];
+        for (int x=x0; x<=xmax; x+=8) {
+            Float8 px = ramp + Float8((float)x);
+            Float8 py((float)y);
+            Float8 e0 = px*Float8(ea[0]) + py*Float8(eb[0]) + Float8(ec[0]);
+            Float8 e1 = px*Float8(ea[1]) + py*Float8(eb[1]) + Float8(ec[1]);
+            Float8 e2 = px*Float8(ea[2]) + py*Float8(eb[2]) + Float8(ec[2]);
+            Float8 touches = (e0 + Float8(touch[0]) >= zero) & (e1 + Float8(touch[1]) >= zero)
+                           & (e2 + Float8(touch[2]) >= zero);
+            if (!touches.movemask()) continue;
+            Float8 z = max(px*Float8(za) + py*Float8(zb) + Float8(zc), zfar8);
+            min(Float8::load(zrow + x), select(touches, z, none)).store(zrow + x);
+            // пиксель, которого не задевает контур, лежит в куске целиком или вне его:
+            // раз треугольник куска его задевает - закрыт. Центр пикселя на внутреннем
+            // ребре тут не нужен - его знак у соседних треугольников зависит от округления
+            max(Float8::load(crow + x), select(touches, one, zero)).store(crow + x);
+            // пиксель целиком внутри одного треугольника закрыт им самим, контур не нужен
+            Float8 whole = (e0 - Float8(touch[0]) >= zero) & (e1 - Float8(touch[1]) >= zero)
+                         & (e2 - Float8(touch[2]) >= zero);
+            if (whole.movemask())
+                max(Float8::load(drow + x), select(whole, z*Float8(1.f - OCCLUSION_DEPTH_EPS), zero)).store(drow + x);
+        }
+    }
+}
+
+// все пиксели окна, которые задевает отрезок контура (a, b), с запасом
+void OcclusionBuffer::outline(float ax, float ay, float bx, float by, int x0, int y0, int x1, int y1) {
+    const float eps = OCCLUSION_EDGE_EPS;
+    if (ay>by) {
+        std::swap(ax, bx);
+        std::swap(ay, by);
+    }
+    int ya = std::max(y0, (int)std::floor(ay - eps)), yb = std::min(y1, (int)std::floor(by + eps));
+    for (int y=ya; y<=yb; y++) {
+        // часть отрезка в полосе строки [y, y+1]
+        float lo = std::max(ay, y - eps), hi = std::min(by, y + 1 + eps);
+        float xa = ax, xb = bx;
+        if (by>ay) {
+            float k = (bx - ax) / (by - ay);
+            xa = ax + (lo - ay)*k;
+            xb = ax + (hi - ay)*k;
+        }
+        if (xa>xb) std::swap(xa, xb);
+        int xs = std::max(x0, (int)std::floor(xa - eps)), xe = std::min(x1, (int)std::floor(xb + eps));
+        if (xs<=xe) memset(&edge_[y*stride_ + xs], 1, xe - xs + 1);
+    }
+}
+
+bool OcclusionBuffer::box_visible(const float lo[3], const float hi[3]) {
+    stats_.tested++;
+    float xmin = 1e30f, ymin = 1e30f, xmax = -1e30f, ymax = -1e30f, znear = 0;
+    for (int k=0; k<8; k++) {
+        float p[3] = { k&1 ? hi[0] : lo[0], k&2 ? hi[1] : lo[1], k&4 ? hi[2] : lo[2] };
+        float c[3];
+        project(p, c);
+        if (!(c[2]>=OCCLUSION_NEAR_W)) return true;
+        float iw = 1.f / c[2];
+        float sx = (c[0]*iw*.5f + .5f) * width_, sy = (c[1]*iw*.5f + .5f) * height_;
+        xmin = std::min(xmin, sx);
+        ymin = std::min(ymin, sy);
+        xmax = std::max(xmax, sx);
+        ymax = std::max(ymax, sy);
+        znear = std::max(znear, iw); // w линейна, ближайшая точка AABB - угол
+    }
+    if (xmax<0 || ymax<0 || xmin>=width_ || ymin>=height_) {
+        stats_.offscreen++;
+        return false;
+    }
+    // все пиксели, которые задевает прямоугольник: закрытые пиксели закрыты целиком
+    int x0 = std::max(0, (int)std::floor(xmin)), x1 = std::min(width_-1,  (int)std::floor(xmax));
+    int y0 = std::max(0, (int)std::floor(ymin)), y1 = std::min(height_-1, (int)std::floor(ymax));
+
+    // видим, если хоть в одном пикселе окклюдер не ближе ближайшей точки AABB
+    Float8 ramp = Float8::ramp(), z8(znear);
+    Float8 fx0((float)x0), fx1((float)x1);
+    for (int y=y0; y<=y1; y++) {
+        const float *row = &depth_[y*stride_];
+        for (int x = x0 & ~7; x<=x1; x+=8) {
+            Float8 px = ramp + Float8((float)x);
+            Float8 lanes = (px >= fx0) & (fx1 >= px);
+            if (((z8 >= Float8::load(row + x)) & lanes).movemask()) return true;
+        }
+    }
+    stats_.occluded++;
+    return false;
+}
@@ -0,0 +1,113 @@
+// occlusion.h
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+#include <vector>
+
+// отсечение по перекрытию на CPU: окклюдеры растеризуются в буфер глубины низкого
+// разрешения, затем AABB групп граней (мешлетов, DrawItem'ов) проверяются по нему.
+// От рендерера не зависит, нужен только simd.h: матрица - 16 float по строкам,
+// clip = M * (x, y, z, 1), экран - x/w и y/w в [-1, 1], глубина - w (растёт от камеры).
+// Растеризация консервативная: пиксель закрыт, только если он целиком внутри
+// окклюдера. Треугольники одного вызова add_occluders сшиваются по совпадающим
+// вершинам; ребро внутреннее, если его делят ровно два треугольника одной
+// ориентации на экране, остальные рёбра - контур (край открытой сетки, силуэт,
+// сосед за ближней плоскостью); внутренние рёбра склеивают треугольники в куски.
+// Пиксель закрыт куском, если его задевает треугольник куска, а контур куска не
+// задевает (тогда пиксель в куске целиком, и трещин по внутренним рёбрам нет), глубина - нижняя граница 1/w треугольников куска, задевающих
+// пиксель; пиксель целиком внутри одного треугольника закрыт и без этого. Так
+// открытые и несшитые сетки не дают дыр в проверке
+
+// окклюдеры ближе этого w к камере пропускаются, AABB считаются видимыми
+static const float OCCLUSION_NEAR_W = 1e-2f;
+
+struct OcclusionStats {
+    long long occluders; // растеризованные треугольники
+    long long skipped;   // окклюдеры у ближней плоскости, далеко за экраном или вырожденные
+    long long tested;    // проверенные AABB
+    long long occluded;  // закрыты окклюдерами
+    long long offscreen; // целиком вне экрана
+
+    OcclusionStats() : occluders(0), skipped(0), tested(0), occluded(0), offscreen(0) {}
+};
+
+class OcclusionBuffer {
+public:
+    OcclusionBuffer(int width, int height);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    void set_transform(const float m[16]);
+    // новый кадр: ничего не закрыто; статистика сбрасывается
+    void clear();
+
+    // треугольники из вершин verts (x, y, z float, шаг stride байт) по тройкам
+    // indices; indices = NULL - вершины подряд
+    void add_occluders(const float *verts, int stride, const unsigned int *indices, int ntris);
+    // false - AABB [lo, hi] целиком закрыт или вне экрана
+    bool box_visible(const float lo[3], const float hi[3]);
+
+    // 1/w самого дальнего окклюдера в пикселе, 0 - не закрыт; строки по stride() float
+    const float *depth() const { return &depth_[0]; }
+    int stride() const { return stride_; }
+    const OcclusionStats &stats() const { return stats_; }
+
+private:
+    int width_, height_;
+    int stride_; // ширина, выровненная до 8
+    float m_[16];
+    std::vector<float> depth_;
+    OcclusionStats stats_;
+
+    // треугольник вызова add_occluders на экране буфера
+    struct Triangle {
+        float sx[3], sy[3], iw[3];
+        int side;  // 0 - против часовой на экране, 1 - по часовой
+        int group; // кусок, связанный внутренними рёбрами
+    };
+    // ребро tri от вершины corner к следующей; lo < hi - номера сшитых вершин
+    struct Edge {
+        int side, lo, hi;
+        bool forward; // обход от lo к hi
+        int tri, corner;
+        bool operator<(const Edge &e) const {
+            if (side!=e.side) return side<e.side;
+            if (lo!=e.lo) return lo<e.lo;
+            return hi<e.hi;
+        }
+    };
+    // вершина по битам координат, для сшивки
+    struct Weld {
+        unsigned int key[3];
+        int corner; // tri*3 + j
+        bool operator<(const Weld &w) const {
+            if (key[0]!=w.key[0]) return key[0]<w.key[0];
+            if (key[1]!=w.key[1]) return key[1]<w.key[1];
+            return key[2]<w.key[2];
+        }
+    };
+    // порядок по кускам для сортировки треугольников и рёбер контура
+    struct ByGroup {
+        const std::vector<Triangle> &tris;
+        ByGroup(const std::vector<Triangle> &t) : tris(t) {}
+        bool operator()(int a, int b) const { return tris[a].group<tris[b].group; }
+        bool operator()(const Edge &a, const Edge &b) const { return tris[a.tri].group<tris[b.tri].group; }
+    };
+    // рабочие буферы вызова, память переиспользуется между кадрами
+    std::vector<Triangle> tris_;
+    std::vector<Weld> welds_;
+    std::vector<int> ids_, parent_, order_;
+    std::vector<Edge> edges_, outline_;
+    std::vector<float> cover_, zmin_;   // задет куском; нижняя граница 1/w
+    std::vector<unsigned char> edge_;   // пиксель задет контуром
+
+    // (x, y, w) после m_
+    void project(const float *p, float out[3]) const;
+    bool setup(const float clip[3][3], Triangle &t) const;
+    int root(int t);
+    void rasterize(const int *order, int ntris, const Edge *edges, int nedges);
+    void triangle(const Triangle &t, int y0, int y1);
+    void outline(float ax, float ay, float bx, float by, int x0, int y0, int x1, int y1);
+};
+
+#endif // __OCCLUSION_H__
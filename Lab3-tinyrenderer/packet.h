@@ -0,0 +1,68 @@
+// packet.h
+#ifndef __PACKET_H__
+#define __PACKET_H__
+
+#include "geometry.h"
+#include "matrix.h"
+#include "simd.h"
+
+// пакеты по 8 векторов: каждая компонента - Float8, вектор i лежит в дорожке i.
+// Операции те же, что у Vec3f/Vec4f, и считаются в том же порядке, поэтому
+// дорожка совпадает со скалярным результатом; маски - результаты сравнений Float8
+
+struct Vec3f8 {
+    Float8 x, y, z;
+
+    Vec3f8() {}
+    Vec3f8(const Float8 &_x, const Float8 &_y, const Float8 &_z) : x(_x), y(_y), z(_z) {}
+    // один вектор во все дорожки
+    explicit Vec3f8(const Vec3f &v) : x(v.x), y(v.y), z(v.z) {}
+
+    static Vec3f8 load(const float *xs, const float *ys, const float *zs) {
+        return Vec3f8(Float8::load(xs), Float8::load(ys), Float8::load(zs));
+    }
+    void store(float *xs, float *ys, float *zs) const {
+        x.store(xs);
+        y.store(ys);
+        z.store(zs);
+    }
+
+    Vec3f8 operator ^(const Vec3f8 &v) const { return Vec3f8(y*v.z-z*v.y, z*v.x-x*v.z, x*v.y-y*v.x); }
+    Vec3f8 operator +(const Vec3f8 &v) const { return Vec3f8(x+v.x, y+v.y, z+v.z); }
+    Vec3f8 operator -(const Vec3f8 &v) const { return Vec3f8(x-v.x, y-v.y, z-v.z); }
+    Vec3f8 operator *(const Float8 &f) const { return Vec3f8(x*f, y*f, z*f); }
+    Float8 operator *(const Vec3f8 &v) const { return x*v.x + y*v.y + z*v.z; }
+
+    Float8 norm() const { return sqrt(x*x+y*y+z*z); }
+    Vec3f8 & normalize(float l=1) { *this = (*this)*(Float8(l)/norm()); return *this; }
+};
+
+inline Vec3f8 select(const Float8 &mask, const Vec3f8 &a, const Vec3f8 &b) {
+    return Vec3f8(select(mask, a.x, b.x), select(mask, a.y, b.y), select(mask, a.z, b.z));
+}
+
+inline Vec3f8 abs(const Vec3f8 &v) { return Vec3f8(abs(v.x), abs(v.y), abs(v.z)); }
+inline Vec3f8 min(const Vec3f8 &a, const Vec3f8 &b) { return Vec3f8(min(a.x, b.x), min(a.y, b.y), min(a.z, b.z)); }
+inline Vec3f8 max(const Vec3f8 &a, const Vec3f8 &b) { return Vec3f8(max(a.x, b.x), max(a.y, b.y), max(a.z, b.z)); }
+
+struct Vec4f8 {
+    Float8 x, y, z, w;
+
+    Vec4f8() {}
+    Vec4f8(const Float8 &_x, const Float8 &_y, const Float8 &_z, const Float8 &_w) : x(_x), y(_y), z(_z), w(_w) {}
+    Vec4f8(const Vec3f8 &v, const Float8 &_w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+};
+
+// 8 точек одной матрицей; сумма по порядку, как в Mat4 * Vec4f
+inline Vec4f8 operator*(const Mat4 &m, const Vec4f8 &v) {
+    Float8 r[4];
+    for (int i=0; i<4; i++)
+        r[i] = Float8(m[i].x)*v.x + Float8(m[i].y)*v.y + Float8(m[i].z)*v.z + Float8(m[i].w)*v.w;
+    return Vec4f8(r[0], r[1], r[2], r[3]);
+}
+
+inline Vec3f8 project(const Vec4f8 &v) {
+    return Vec3f8(v.x / v.w, v.y / v.w, v.z / v.w);
+}
+
+#endif // __PACKET_H__
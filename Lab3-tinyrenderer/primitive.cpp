@@ -0,0 +1,119 @@
+#include <cmath>
+#include <algorithm>
+#include "primitive.h"
+
+PrimitiveStage::PrimitiveStage(int width, int height) : width_(width), height_(height), guard_(0), cull_(CULL_BACK) {
+    set_guard_band(1024);
+}
+
+void PrimitiveStage::set_guard_band(int pixels) {
+    guard_ = std::max(0, std::min(pixels, 4095 - std::max(width_, height_)));
+}
+
+float PrimitiveStage::plane(int i, const ClipVertex &v, bool guard) const {
+    float g = guard ? float(guard_) : 0.f;
+    switch (i) {
+        case 0:  return v.w - NEAR_W;
+        case 1:  return v.x + g*v.w;              // x/w >= -g
+        case 2:  return (width_ + g)*v.w - v.x;   // x/w <= width+g
+        case 3:  return v.y + g*v.w;
+        default: return (height_ + g)*v.w - v.y;
+    }
+}
+
+static ClipVertex lerp(const ClipVertex &a, const ClipVertex &b, float t) {
+    ClipVertex r;
+    r.x = a.x + (b.x - a.x)*t;
+    r.y = a.y + (b.y - a.y)*t;
+    r.z = a.z + (b.z - a.z)*t;
+    r.w = a.w + (b.w - a.w)*t;
+    r.uv = a.uv + (b.uv - a.uv)*t;
+    return r;
+}
+
+void PrimitiveStage::add(const ClipVertex v[3], float intensity, std::vector<RasterTriangle> &out) {
+    stats_.input++;
+
+    // все вершины вне одной плоскости экрана (или за камерой) - треугольник не виден;
+    // в однородных координатах проверка верна и для w<0
+    int outside = 0;
+    for (int i=0; i<5; i++) {
+        if (plane(i, v[0], false)<0 && plane(i, v[1], false)<0 && plane(i, v[2], false)<0) {
+            stats_.frustum++;
+            return;
+        }
+        for (int j=0; j<3; j++)
+            if (plane(i, v[j], true)<0) outside |= 1<<i;
+    }
+    if (!outside) {
+        emit(v, 3, intensity, out);
+        return;
+    }
+
+    // Сазерленд-Ходжман только по нарушенным плоскостям; каждая плоскость
+    // добавляет не больше одной вершины
+    stats_.clipped++;
+    ClipVertex buf[2][8];
+    int n = 3;
+    std::copy(v, v+3, buf[0]);
+    int cur = 0;
+    for (int i=0; i<5 && n>=3; i++) {
+        if (!(outside & (1<<i))) continue;
+        const ClipVertex *in = buf[cur];
+        ClipVertex *res = buf[cur^1];
+        int m = 0;
+        for (int j=0; j<n; j++) {
+            const ClipVertex &a = in[j], &b = in[(j+1)%n];
+            float da = plane(i, a, true), db = plane(i, b, true);
+            if (da>=0) res[m++] = a;
+            if ((da>=0) != (db>=0)) res[m++] = lerp(a, b, da/(da-db));
+        }
+        n = m;
+        cur ^= 1;
+    }
+    if (n<3) {
+        stats_.frustum++;
+        return;
+    }
+    emit(buf[cur], n, intensity, out);
+}
+
+// многоугольник после отсечения: деление на w, отбраковка, веер треугольников
+void PrimitiveStage::emit(const ClipVertex *poly, int n, float intensity, std::vector<RasterTriangle> &out) {
+    Vec3f screen[8];
+    long long X[8], Y[8];
+    for (int i=0; i<n; i++) {
+        screen[i] = Vec3f(poly[i].x/poly[i].w, poly[i].y/poly[i].w, poly[i].z/poly[i].w);
+        X[i] = std::llround(screen[i].x * SUBPIXEL_ONE);
+        Y[i] = std::llround(screen[i].y * SUBPIXEL_ONE);
+    }
+
+    // удвоенная площадь на сетке 28.4, > 0 - против часовой
+    long long area = 0;
+    for (int i=0; i<n; i++) {
+        int j = (i+1)%n;
+        area += X[i]*Y[j] - X[j]*Y[i];
+    }
+    if (area==0) {
+        stats_.zero_area++;
+        return;
+    }
+    if ((cull_==CULL_BACK && area<0) || (cull_==CULL_FRONT && area>0)) {
+        stats_.backface++;
+        return;
+    }
+
+    for (int k=1; k+1<n; k++) {
+        const int idx[3] = { 0, k, k+1 };
+        RasterTriangle t;
+        for (int j=0; j<3; j++) {
+            const Vec3f &s = screen[idx[j]];
+            t.screen[j] = s;
+            t.pts[j] = Vec3i(int(s.x + .5f), int(s.y + .5f), int(s.z + .5f));
+            t.uvs[j] = poly[idx[j]].uv;
+        }
+        t.intensity = intensity;
+        out.push_back(t);
+        stats_.output++;
+    }
+}
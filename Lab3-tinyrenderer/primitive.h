@@ -0,0 +1,68 @@
+// primitive.h
+#ifndef __PRIMITIVE_H__
+#define __PRIMITIVE_H__
+
+#include <vector>
+#include "geometry.h"
+#include "matrix.h"
+#include "rasterizer.h"
+
+// стадия примитивов между преобразованием вершин и растеризацией:
+// отсечение по пирамиде видимости в однородных координатах, guard band,
+// отбрасывание задних и вырожденных граней в экранных координатах
+
+// вершина после ViewPort*Projection*View, до деления на w
+struct ClipVertex {
+    float x, y, z, w;
+    Vec2f uv;
+
+    ClipVertex() : x(0), y(0), z(0), w(1) {}
+    ClipVertex(const Vec4f &c, const Vec2f &t) : x(c.x), y(c.y), z(c.z), w(c.w), uv(t) {}
+};
+
+enum CullMode { CULL_NONE, CULL_BACK, CULL_FRONT };
+
+// вершины ближе этого w к плоскости камеры отсекаются
+static const float NEAR_W = 1e-2f;
+
+struct PrimitiveStats {
+    long long input;     // треугольники на входе
+    long long frustum;   // целиком вне экрана или за камерой
+    long long backface;  // отброшены по ориентации
+    long long zero_area; // нулевая площадь на сетке 1/16 пикселя
+    long long clipped;   // прошли через отсечение (вышли за guard band или ближнюю плоскость)
+    long long output;    // треугольники для растеризатора
+
+    PrimitiveStats() : input(0), frustum(0), backface(0), zero_area(0), clipped(0), output(0) {}
+};
+
+class PrimitiveStage {
+public:
+    PrimitiveStage(int width, int height);
+
+    // лицевая грань на экране обходится против часовой (y вверх)
+    void set_cull(CullMode mode) { cull_ = mode; }
+    // запас в пикселях вокруг экрана, внутри которого треугольники не режутся -
+    // растеризатор сам обрезает bbox; запас ограничен так, чтобы координаты были
+    // меньше 4096 (кадр - до 4095, см. --size): тогда произведения координат в
+    // рёберных функциях меньше 2^24, а сами значения рёбер - до ~2^25 (EdgeSetup)
+    void set_guard_band(int pixels);
+    const PrimitiveStats &stats() const { return stats_; }
+    void reset_stats() { stats_ = PrimitiveStats(); }
+
+    // один треугольник модели: 0, 1 или несколько треугольников в out
+    void add(const ClipVertex v[3], float intensity, std::vector<RasterTriangle> &out);
+
+private:
+    int width_, height_;
+    int guard_;
+    CullMode cull_;
+    PrimitiveStats stats_;
+
+    // i-я плоскость отсечения (ближняя, затем 4 стороны guard band, или
+    // 4 стороны экрана при guard=false); >=0 - внутри
+    float plane(int i, const ClipVertex &v, bool guard) const;
+    void emit(const ClipVertex *poly, int n, float intensity, std::vector<RasterTriangle> &out);
+};
+
+#endif // __PRIMITIVE_H__
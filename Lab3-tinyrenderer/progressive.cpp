@@ -0,0 +1,93 @@
+#include <cstring>
+#include "progressive.h"
+#include "tank.h"
+
+// экранные координаты делятся на scale, z не меняется
+static void scale_triangles(const std::vector<RasterTriangle> &tris, int scale, std::vector<RasterTriangle> &out) {
+    float k = 1.f / scale;
+    out.resize(tris.size());
+    for (size_t i=0; i<tris.size(); i++) {
+        RasterTriangle &t = out[i];
+        t = tris[i];
+        for (int j=0; j<3; j++) {
+            t.screen[j].x *= k;
+            t.screen[j].y *= k;
+            t.pts[j] = Vec3i(int(t.screen[j].x + .5f), int(t.screen[j].y + .5f), t.pts[j].z);
+        }
+    }
+}
+
+// каждый пиксель level - в квадрат scale x scale кадра. Сетка уровня выровнена по
+// кадру, а не по окну: пиксель окна (x, y) - пиксель уровня ((x+ox)/scale, (y+oy)/scale)
+static void upscale(TGAImage &level, int scale, int ox, int oy, TGAImage &frame) {
+    int bpp = frame.get_bytespp();
+    int w = frame.get_width(), h = frame.get_height(), lw = level.get_width();
+    unsigned char *dst = frame.buffer();
+    const unsigned char *src = level.buffer();
+    for (int y=0; y<h; y++) {
+        const unsigned char *row = src + ((y+oy)/scale - oy/scale)*lw*bpp;
+        for (int x=0; x<w; x++) memcpy(dst + (x + y*w)*bpp, row + ((x+ox)/scale - ox/scale)*bpp, bpp);
+    }
+}
+
+ProgressiveStats render_progressive(const std::vector<RasterTriangle> &tris, Model &model,
+                                    const ViewOptions &opt, int origin_x, int origin_y,
+                                    TGAImage &image, PreviewFunc preview) {
+    ProgressiveStats stats;
+    int width = image.get_width(), height = image.get_height(), bpp = image.get_bytespp();
+
+    // лучи танка: 0 - ещё не пущен, 1 - мимо, 2 - попал, цвет в tank_color
+    std::vector<unsigned char> tank_state(TANK_SIZE*TANK_SIZE, 0);
+    std::vector<TGAColor> tank_color(TANK_SIZE*TANK_SIZE);
+    std::vector<RasterTriangle> scaled;
+    TGAImage snapshot;
+
+    for (int scale = PREVIEW_SCALE; scale>=1; scale /= 2) {
+        // окно уровня: пиксели уровня, в которые попадает окно кадра
+        int lx = origin_x/scale, ly = origin_y/scale;
+        int w = (origin_x + width-1)/scale - lx + 1, h = (origin_y + height-1)/scale - ly + 1;
+        TGAImage level;
+        if (scale>1) level = TGAImage(w, h, bpp);
+        TGAImage &target = scale>1 ? level : image;
+
+        Rasterizer rasterizer(w, h);
+        rasterizer.set_origin(lx, ly);
+        rasterizer.set_threads(opt.threads);
+        rasterizer.set_mode(opt.mode);
+        rasterizer.set_depth_format(opt.depth, 0.f, opt.zfar);
+        if (scale>1) {
+            scale_triangles(tris, scale, scaled);
+            rasterizer.draw(scaled, model, target);
+        } else {
+            rasterizer.draw(tris, model, target);
+        }
+        stats.raster += rasterizer.stats();
+
+        // танк поверх треугольников: пиксели окна уровня, чей сэмпл внутри квадрата танка
+        int x0 = std::max(lx, (TANK_X + scale-1)/scale), x1 = std::min(lx + w, (TANK_X + TANK_SIZE + scale-1)/scale);
+        int y0 = std::max(ly, (TANK_Y + scale-1)/scale), y1 = std::min(ly + h, (TANK_Y + TANK_SIZE + scale-1)/scale);
+        for (int y=y0; y<y1; y++) {
+            for (int x=x0; x<x1; x++) {
+                int tx = x*scale - TANK_X, ty = y*scale - TANK_Y;
+                int idx = tx + ty*TANK_SIZE;
+                if (tank_state[idx]==0) {
+                    tank_state[idx] = tank_pixel(tx, ty, tank_color[idx]) ? 2 : 1;
+                    stats.rays++;
+                } else {
+                    stats.reused++;
+                }
+                if (tank_state[idx]==2) target.set(x - lx, y - ly, tank_color[idx]);
+            }
+        }
+
+        if (!preview) continue;
+        if (scale>1) {
+            if (!snapshot.buffer()) snapshot = TGAImage(width, height, bpp);
+            upscale(level, scale, origin_x, origin_y, snapshot);
+            preview(snapshot, scale);
+        } else {
+            preview(image, 1);
+        }
+    }
+    return stats;
+}
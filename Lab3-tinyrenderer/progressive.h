@@ -0,0 +1,38 @@
+// progressive.h
+#ifndef __PROGRESSIVE_H__
+#define __PROGRESSIVE_H__
+
+#include <vector>
+#include "tgaimage.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "multiview.h"
+
+// готов очередной уровень: image - кадр (окно) полного размера, пиксель уровня
+// размножен в квадрат scale x scale; на последнем уровне scale = 1
+typedef void (*PreviewFunc)(const TGAImage &image, int scale);
+
+// первый уровень - 1/8 разрешения, дальше 1/4, 1/2 и полный кадр
+static const int PREVIEW_SCALE = 8;
+
+struct ProgressiveStats {
+    long long rays;   // лучи танка, пущенные на всех уровнях
+    long long reused; // сэмплы танка, взятые с грубого уровня
+    RasterStats raster; // сумма по уровням
+
+    ProgressiveStats() : rays(0), reused(0) {}
+};
+
+// треугольники tris (в координатах кадра, после PrimitiveStage) и танк, от
+// грубого уровня к полному. Setup треугольников делается один раз, на уровне
+// они только масштабируются. Сэмпл танка уровня 1/s - луч через пиксель кадра
+// (x*s, y*s), поэтому все сэмплы грубого уровня входят в следующий и повторно
+// не считаются: на каждом уровне пускается 3/4 лучей. В image остаётся полный
+// кадр, такой же, как у Rasterizer::draw и render_tank.
+// image может быть окном кадра с левым нижним углом (origin_x, origin_y), как
+// Rasterizer::set_origin; сетка грубых уровней при этом выровнена по кадру
+ProgressiveStats render_progressive(const std::vector<RasterTriangle> &tris, Model &model,
+                                    const ViewOptions &opt, int origin_x, int origin_y,
+                                    TGAImage &image, PreviewFunc preview);
+
+#endif // __PROGRESSIVE_H__
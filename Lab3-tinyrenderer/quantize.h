@@ -0,0 +1,65 @@
+// quantize.h
+#ifndef __QUANTIZE_H__
+#define __QUANTIZE_H__
+
+#include <cmath>
+#include <algorithm>
+#include "geometry.h"
+
+// сжатие вершинных данных: значения 16 бит без знака внутри границ
+// [lo, lo + 65535*step], единичные векторы - октаэдром в 2 x 16 бит со знаком
+
+static const float QUANT_LEVELS = 65535.f;
+static const float OCT_LEVELS = 32767.f;
+// код нулевого вектора (вырожденная грань); кодировщик его не выдаёт
+static const unsigned int OCT_ZERO = 0x80008000u;
+
+// шаг сетки для диапазона [lo, hi]; 0 - диапазон из одной точки
+inline float quant_step(float lo, float hi) {
+    return (hi-lo)/QUANT_LEVELS;
+}
+
+inline unsigned short quantize16(float v, float lo, float step) {
+    if (step<=0) return 0;
+    float q = std::floor((v-lo)/step + .5f);
+    return (unsigned short)std::max(0.f, std::min(QUANT_LEVELS, q));
+}
+
+// так же деквантуется пакетом: Float8(lo) + Float8::load_u16(q)*Float8(step)
+inline float dequantize16(unsigned short q, float lo, float step) {
+    return lo + (float)q*step;
+}
+
+static inline float sign_not_zero(float v) { return v<0 ? -1.f : 1.f; }
+
+static inline unsigned int snorm16(float v) {
+    float q = std::floor(std::max(-1.f, std::min(1.f, v))*OCT_LEVELS + .5f);
+    return (unsigned int)(unsigned short)(short)q;
+}
+
+// нижняя полусфера отражается на углы квадрата [-1, 1]^2
+inline unsigned int oct_encode(const Vec3f &n) {
+    float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (!(l1>0)) return OCT_ZERO;
+    float u = n.x/l1, v = n.y/l1;
+    if (n.z<0) {
+        float fu = (1.f - std::fabs(v))*sign_not_zero(u);
+        float fv = (1.f - std::fabs(u))*sign_not_zero(v);
+        u = fu;
+        v = fv;
+    }
+    return snorm16(u) | (snorm16(v) << 16);
+}
+
+inline Vec3f oct_decode(unsigned int code) {
+    if (code==OCT_ZERO) return Vec3f(0, 0, 0);
+    float u = (short)(code & 0xffff)/OCT_LEVELS, v = (short)(code >> 16)/OCT_LEVELS;
+    Vec3f n(u, v, 1.f - std::fabs(u) - std::fabs(v));
+    if (n.z<0) {
+        n.x = (1.f - std::fabs(v))*sign_not_zero(u);
+        n.y = (1.f - std::fabs(u))*sign_not_zero(v);
+    }
+    return n.normalize();
+}
+
+#endif // __QUANTIZE_H__
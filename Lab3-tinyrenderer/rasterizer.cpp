@@ -0,0 +1,775 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include "rasterizer.h"
+
+Vec3f barycentric(Vec3f A, Vec3f B, Vec3f C, Vec3f P) {
+    Vec3f s[2];
+    for (int i=2; i--; ) {
+        s[i][0] = C[i]-A[i];
+        s[i][1] = B[i]-A[i];
+        s[i][2] = A[i]-P[i];
+    }
+
+    Vec3f u = s[0] ^ s[1];
+
+    if (std::abs(u[2])>1e-2) return Vec3f(1.f-(u.x+u.y)/u.z, u.y/u.z, u.x/u.z);
+    return Vec3f(-1,1,1); // тчк вне треугольника
+}
+
+float nearest_z(const RasterTriangle &t) {
+    float z = -std::numeric_limits<float>::max();
+    for (int i=0; i<3; i++) z = std::max(z, std::max(float(t.pts[i].z), t.screen[i].z));
+    return z + HIZ_EPSILON;
+}
+
+float depth_floor(const RasterTarget &t, int idx) {
+    if (t.depth_format==DEPTH_32F) return t.zbuffer[idx];
+    unsigned int q = t.depth_format==DEPTH_16 ? t.zbuffer16[idx] : t.zbuffer24[idx];
+    if (q==0) return -std::numeric_limits<float>::max();
+    // тест проходит только z >= near + (q+.5)/scale, берём на единицу меньше с запасом
+    return t.depth_near + (q - .5f)/t.depth_scale;
+}
+
+void hiz_refresh(RasterTarget &target, int bx, int by) {
+    int x0 = bx*HIZ_BLOCK, y0 = by*HIZ_BLOCK;
+    int y1 = std::min(y0 + HIZ_BLOCK, target.height);
+    float zmin = std::numeric_limits<float>::max();
+    if (!target.zbuffer && x0 + HIZ_BLOCK <= target.width) {
+        // минимум в единицах буфера, затем тот же перевод, что в depth_floor
+        Float8 m(std::numeric_limits<float>::max());
+        for (int y=y0; y<y1; y++) {
+            int idx = x0 + y*target.width;
+            m = min(m, target.zbuffer16 ? Float8::load_u16(target.zbuffer16 + idx)
+                                        : Float8::load_u32(target.zbuffer24 + idx));
+        }
+        float q = m.hmin();
+        zmin = q==0 ? -std::numeric_limits<float>::max() : target.depth_near + (q - .5f)/target.depth_scale;
+    } else if (!target.zbuffer) {
+        int x1 = std::min(x0 + HIZ_BLOCK, target.width);
+        for (int y=y0; y<y1; y++)
+            for (int x=x0; x<x1; x++) zmin = std::min(zmin, depth_floor(target, x + y*target.width));
+    } else if (x0 + HIZ_BLOCK <= target.width) {
+        Float8 m = Float8::load(target.zbuffer + x0 + y0*target.width);
+        for (int y=y0+1; y<y1; y++) m = min(m, Float8::load(target.zbuffer + x0 + y*target.width));
+        zmin = m.hmin();
+    } else {
+        int x1 = target.width;
+        for (int y=y0; y<y1; y++)
+            for (int x=x0; x<x1; x++) zmin = std::min(zmin, target.zbuffer[x + y*target.width]);
+    }
+    target.hiz[bx + by*target.hiz_width] = zmin;
+}
+
+// uv по барицентрическим координатам, diffuse * intensity
+static inline TGAColor shade_color(const RasterTriangle &t, const Vec3f &bc, RasterTarget &target) {
+    const Vec2f *uvs = t.uvs;
+    Vec2f uv;
+    uv.x = uvs[0].x * bc.x + uvs[1].x * bc.y + uvs[2].x * bc.z;
+    uv.y = uvs[0].y * bc.x + uvs[1].y * bc.y + uvs[2].y * bc.z;
+
+    TGAColor color = target.model->diffuse(uv);
+
+    color.r *= t.intensity;
+    color.g *= t.intensity;
+    color.b *= t.intensity;
+    return color;
+}
+
+static inline void shade_pixel(const RasterTriangle &t, const Vec3f &bc, int x, int y,
+                               RasterTarget &target) {
+    target.image->set(x, y, shade_color(t, bc, target));
+}
+
+// фрагмент прошёл z-тест: шейдим сразу или откладываем до resolve()
+static inline void shade(const RasterTriangle &t, const Vec3f &bc, int x, int y,
+                         RasterTarget &target) {
+    if (target.vis_id) {
+        int idx = x + y*target.width;
+        target.vis_id[idx] = target.tri_id;
+        target.vis_bc[idx] = bc;
+        return;
+    }
+    shade_pixel(t, bc, x, y, target);
+}
+
+// второй проход отложенного режима: один diffuse на видимый пиксель тайла
+static void resolve(const std::vector<RasterTriangle> &tris, const TileRect &r, RasterTarget &target) {
+    for (int y=r.y0; y<=r.y1; y++) {
+        for (int x=r.x0; x<=r.x1; x++) {
+            int idx = x + y*target.width;
+            if (target.vis_id[idx]<0) continue;
+            shade_pixel(tris[target.vis_id[idx]], target.vis_bc[idx], x, y, target);
+            target.stats.resolved++;
+        }
+    }
+}
+
+void triangle(const RasterTriangle &t, const TileRect &r, RasterTarget &target) {
+    const Vec3i *pts = t.pts;
+    int width = target.width;
+    int ox = target.origin_x, oy = target.origin_y;
+
+    Vec2i bboxmin(r.x1, r.y1);
+    Vec2i bboxmax(r.x0, r.y0);
+    for (int i=0; i<3; i++) {
+        bboxmin.x = std::max(r.x0, std::min(bboxmin.x, pts[i].x - ox));
+        bboxmin.y = std::max(r.y0, std::min(bboxmin.y, pts[i].y - oy));
+        bboxmax.x = std::min(r.x1, std::max(bboxmax.x, pts[i].x - ox));
+        bboxmax.y = std::min(r.y1, std::max(bboxmax.y, pts[i].y - oy));
+    }
+
+    Vec3f A(pts[0].x, pts[0].y, pts[0].z);
+    Vec3f B(pts[1].x, pts[1].y, pts[1].z);
+    Vec3f C(pts[2].x, pts[2].y, pts[2].z);
+
+    Vec3f P;
+    for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++) {
+        for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++) {
+            Vec3f bc_screen = barycentric(A, B, C, Vec3f(P.x + ox, P.y + oy, 0));
+            if (bc_screen.x<0 || bc_screen.y<0 || bc_screen.z<0) continue;
+            target.stats.covered++;
+
+            P.z = 0;
+            P.z += pts[0].z * bc_screen.x;
+            P.z += pts[1].z * bc_screen.y;
+            P.z += pts[2].z * bc_screen.z;
+
+            int idx = int(P.x) + int(P.y)*width;
+            if (depth_less(target, idx, P.z)) {
+                depth_write(target, idx, P.z);
+                target.stats.shaded++;
+
+                shade(t, bc_screen, P.x, P.y, target);
+            }
+        }
+    }
+}
+
+void triangle_edge(const RasterTriangle &t, const TileRect &r, RasterTarget &target) {
+    rasterize_edges(t.pts, r, target, [&](int x, int y, const Vec3f &bc) {
+        shade(t, bc, x, y, target);
+        return true;
+    });
+}
+
+void triangle_micro(const std::vector<RasterTriangle> &tris, const int *ids, int n,
+                    const TileRect &r, RasterTarget &target) {
+    // рёбра и глубина по дорожкам; пустая дорожка - w<0 везде
+    EdgeSetup e[MICRO_BATCH];
+    float a[3][8], b[3][8], c[3][8], za[8], zb[8], zc[8], x0[8], y0[8], w[8], h[8];
+    int wmax = -1, hmax = -1; // обходим только общий для пакета bbox
+    for (int k=0; k<MICRO_BATCH; k++) {
+        bool ok = k<n && e[k].init(tris[ids[k]].pts, r, target);
+        for (int i=0; i<3; i++) {
+            a[i][k] = ok ? e[k].a[i] : 0.f;
+            b[i][k] = ok ? e[k].b[i] : 0.f;
+            c[i][k] = ok ? e[k].c[i] : -1.f;
+        }
+        za[k] = ok ? e[k].za : 0.f;
+        zb[k] = ok ? e[k].zb : 0.f;
+        zc[k] = ok ? e[k].zc : 0.f;
+        x0[k] = ok ? e[k].xmin + e[k].ox : 0.f; // рёбра и z - в точке кадра
+        y0[k] = ok ? e[k].ymin + e[k].oy : 0.f;
+        w[k]  = ok ? e[k].xmax - e[k].xmin : -1.f;
+        h[k]  = ok ? e[k].ymax - e[k].ymin : -1.f;
+        wmax = std::max(wmax, int(w[k]));
+        hmax = std::max(hmax, int(h[k]));
+    }
+    target.stats.micro += n;
+    target.stats.micro_batches++;
+
+    Float8 A[3], B[3], C[3];
+    for (int i=0; i<3; i++) {
+        A[i] = Float8::load(a[i]);
+        B[i] = Float8::load(b[i]);
+        C[i] = Float8::load(c[i]);
+    }
+    Float8 ZA = Float8::load(za), ZB = Float8::load(zb), ZC = Float8::load(zc);
+    Float8 X0 = Float8::load(x0), Y0 = Float8::load(y0);
+    Float8 W = Float8::load(w), H = Float8::load(h);
+    const Float8 zero(0.f);
+
+    // покрытие: бит k в cover[dy][dx] - пиксель внутри треугольника k; выражения
+    // те же, что в rasterize_edges, поэтому z и барицентрики совпадают до бита
+    int cover[MICRO_SIZE][MICRO_SIZE] = {{0}};
+    float zs[MICRO_SIZE][MICRO_SIZE][8], w1s[MICRO_SIZE][MICRO_SIZE][8], w2s[MICRO_SIZE][MICRO_SIZE][8];
+    for (int dy=0; dy<=hmax; dy++) {
+        Float8 fy = Y0 + Float8(float(dy));
+        Float8 in_y = H >= Float8(float(dy));
+        for (int dx=0; dx<=wmax; dx++) {
+            Float8 X = X0 + Float8(float(dx));
+            Float8 w0 = A[0] * X + C[0] + B[0] * fy;
+            Float8 w1 = A[1] * X + C[1] + B[1] * fy;
+            Float8 w2 = A[2] * X + C[2] + B[2] * fy;
+            int m = ((w0>=zero) & (w1>=zero) & (w2>=zero) & in_y & (W >= Float8(float(dx)))).movemask();
+            cover[dy][dx] = m;
+            if (!m) continue;
+            (ZA * X + ZC + ZB * fy).store(zs[dy][dx]);
+            w1.store(w1s[dy][dx]);
+            w2.store(w2s[dy][dx]);
+        }
+    }
+
+    for (int k=0; k<n; k++) {
+        const RasterTriangle &t = tris[ids[k]];
+        target.tri_id = ids[k];
+        for (int dy=0; dy<=int(h[k]); dy++) {
+            for (int dx=0; dx<=int(w[k]); dx++) {
+                if (!(cover[dy][dx] & (1<<k))) continue;
+                target.stats.covered++;
+                int x = e[k].xmin + dx;
+                int y = e[k].ymin + dy;
+                int idx = x + y*target.width;
+                if (!depth_less(target, idx, zs[dy][dx][k])) continue;
+                float b1 = w1s[dy][dx][k]*e[k].inv_area;
+                float b2 = w2s[dy][dx][k]*e[k].inv_area;
+                shade(t, Vec3f(1.f-b1-b2, b1, b2), x, y, target);
+                depth_write(target, idx, zs[dy][dx][k]);
+                target.stats.shaded++;
+            }
+        }
+    }
+}
+
+void sort_front_to_back(const std::vector<float> &depth, std::vector<int> &order) {
+    int n = (int)depth.size();
+    order.resize(n);
+    if (n==0) return;
+
+    float zmin = depth[0], zmax = depth[0];
+    for (int i=1; i<n; i++) {
+        zmin = std::min(zmin, depth[i]);
+        zmax = std::max(zmax, depth[i]);
+    }
+    // ключ растёт от ближних к дальним
+    float scale = zmax>zmin ? 65535.f / (zmax - zmin) : 0.f;
+    std::vector<unsigned short> key(n);
+    for (int i=0; i<n; i++) key[i] = (unsigned short)((zmax - depth[i]) * scale);
+
+    std::vector<int> tmp(n);
+    for (int i=0; i<n; i++) tmp[i] = i;
+    for (int shift=0; shift<16; shift += 8) {
+        int count[257] = {0};
+        for (int i=0; i<n; i++) count[((key[tmp[i]] >> shift) & 0xff) + 1]++;
+        for (int d=0; d<256; d++) count[d+1] += count[d];
+        for (int i=0; i<n; i++) order[count[(key[tmp[i]] >> shift) & 0xff]++] = tmp[i];
+        tmp.swap(order);
+    }
+    order.swap(tmp);
+}
+
+int vrs_2x2(const RasterTriangle &, Model &) {
+    return 1;
+}
+
+int vrs_4x4(const RasterTriangle &, Model &) {
+    return 2;
+}
+
+int vrs_texel_density(const RasterTriangle &t, Model &model) {
+    const Vec3f *v = t.screen;
+    const Vec2f *uv = t.uvs;
+    float screen_area = std::fabs((v[1].x-v[0].x)*(v[2].y-v[0].y) - (v[1].y-v[0].y)*(v[2].x-v[0].x));
+    float uv_area = std::fabs((uv[1].x-uv[0].x)*(uv[2].y-uv[0].y) - (uv[1].y-uv[0].y)*(uv[2].x-uv[0].x));
+    float texels = uv_area * model.diffuse_width() * model.diffuse_height();
+    if (screen_area<=0) return 0;
+    // текселей на пиксель: <1/16 - 4x4, <1/4 - 2x2
+    float density = texels / screen_area;
+    if (density < 1.f/16) return 2;
+    if (density < 1.f/4)  return 1;
+    return 0;
+}
+
+void triangle_vrs(const RasterTriangle &t, const TileRect &r, RasterTarget &target) {
+    int rate = target.vrs(t, *target.model);
+    if (rate<=0) {
+        triangle_edge(t, r, target);
+        return;
+    }
+    const Vec3i *pts = t.pts;
+    int area = (pts[1].x-pts[0].x)*(pts[2].y-pts[0].y) - (pts[1].y-pts[0].y)*(pts[2].x-pts[0].x);
+    if (area==0) return;
+
+    // b_i(x,y) = (a_i*x + b_i*y + c_i) / area, как в rasterize_edges
+    float a[3], b[3], c[3];
+    for (int i=0; i<3; i++) {
+        const Vec3i &p = pts[(i+1)%3];
+        const Vec3i &q = pts[(i+2)%3];
+        a[i] = float(p.y - q.y) / area;
+        b[i] = float(q.x - p.x) / area;
+        c[i] = (float(p.x)*q.y - float(p.y)*q.x) / area;
+    }
+
+    // ячейки кэшируются в пределах блока 8x8, rasterize_edges обходит блоки по одному.
+    // сетка ячеек - в координатах кадра, чтобы окно шейдилось как тот же участок кадра;
+    // блок окна тогда может задеть соседний блок кадра, кэш при этом просто сбрасывается
+    const int n = 1 << rate;
+    const int stride = target.origin_x + target.width;
+    TGAColor cache[16];
+    int stamp[16] = {0};
+    int block = -1, generation = 0;
+    rasterize_edges(pts, r, target, [&](int x, int y, const Vec3f &) {
+        int fx = x + target.origin_x, fy = y + target.origin_y;
+        int blk = (fx>>3) + (fy>>3)*stride;
+        if (blk!=block) {
+            block = blk;
+            generation++;
+        }
+        int cell = (((fy&7)>>rate) << (3-rate)) + ((fx&7)>>rate);
+        if (stamp[cell]!=generation) {
+            float cx = (fx & ~(n-1)) + (n-1)*.5f;
+            float cy = (fy & ~(n-1)) + (n-1)*.5f;
+            // центр ячейки у края может быть вне треугольника - прижимаем к нему
+            float bc[3], sum = 0;
+            for (int i=0; i<3; i++) {
+                bc[i] = std::max(0.f, a[i]*cx + b[i]*cy + c[i]);
+                sum += bc[i];
+            }
+            if (sum<=0) sum = 1;
+            cache[cell] = shade_color(t, Vec3f(bc[0]/sum, bc[1]/sum, bc[2]/sum), target);
+            stamp[cell] = generation;
+            target.stats.coarse++;
+        }
+        target.image->set(x, y, cache[cell]);
+        return true;
+    });
+}
+
+// стандартные расположения сэмплов D3D, в 1/16 пикселя от точки пикселя
+static const int MSAA4[4][2] = { {-2,-6}, {6,-2}, {-6,2}, {2,6} };
+static const int MSAA8[8][2] = { {1,-3}, {-1,3}, {5,1}, {-3,-5}, {-5,5}, {-7,-1}, {3,7}, {7,-7} };
+
+void triangle_msaa(const RasterTriangle &t, const TileRect &r, RasterTarget &target) {
+    const int S = target.samples;
+    const int (*pos)[2] = S==8 ? MSAA8 : MSAA4;
+    const Vec3f *v = t.screen;
+
+    float area = (v[1].x-v[0].x)*(v[2].y-v[0].y) - (v[1].y-v[0].y)*(v[2].x-v[0].x);
+    if (area==0 || area!=area) return;
+    float sign = area>0 ? 1.f : -1.f;
+
+    // сэмплы отстоят от точки пикселя меньше чем на полпикселя; bbox - в координатах окна
+    int ox = target.origin_x, oy = target.origin_y;
+    int xmin = std::max(r.x0, (int)std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x)) - .5f) - ox);
+    int ymin = std::max(r.y0, (int)std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y)) - .5f) - oy);
+    int xmax = std::min(r.x1, (int)std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x)) + .5f) - ox);
+    int ymax = std::min(r.y1, (int)std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y)) + .5f) - oy);
+    if (xmin>xmax || ymin>ymax) return;
+
+    // рёбра как в triangle_edge, но по неокруглённым вершинам; сэмпл ровно на
+    // ребре достаётся только треугольнику, для которого ребро top-left
+    float a[3], b[3], c[3], offs[3][8];
+    bool topleft[3];
+    for (int i=0; i<3; i++) {
+        const Vec3f &p = v[(i+1)%3];
+        const Vec3f &q = v[(i+2)%3];
+        a[i] = sign * (p.y - q.y);
+        b[i] = sign * (q.x - p.x);
+        c[i] = sign * (p.x*q.y - p.y*q.x);
+        topleft[i] = a[i]>0 || (a[i]==0 && b[i]<0);
+        for (int s=0; s<S; s++) offs[i][s] = (a[i]*pos[s][0] + b[i]*pos[s][1]) / 16.f;
+    }
+    float inv_area = 1.f / (sign*area);
+    float za = 0, zb = 0, zc = 0;
+    for (int i=0; i<3; i++) {
+        za += v[i].z * a[i] * inv_area;
+        zb += v[i].z * b[i] * inv_area;
+        zc += v[i].z * c[i] * inv_area;
+    }
+
+    for (int y=ymin; y<=ymax; y++) {
+        for (int x=xmin; x<=xmax; x++) {
+            float fx = x + ox, fy = y + oy; // точка кадра
+            float w[3];
+            for (int i=0; i<3; i++) w[i] = a[i]*fx + b[i]*fy + c[i];
+
+            int idx = x + y*target.width;
+            float *sz = target.sample_z + idx*S;
+            float zcenter = za*fx + zb*fy + zc;
+            int covered = 0, passed = 0;
+            for (int s=0; s<S; s++) {
+                bool inside = true;
+                for (int i=0; i<3; i++) {
+                    float ws = w[i] + offs[i][s];
+                    inside = inside && (ws>0 || (ws==0 && topleft[i]));
+                }
+                if (!inside) continue;
+                covered |= 1<<s;
+                if (sz[s] < zcenter + (za*pos[s][0] + zb*pos[s][1])/16.f) passed |= 1<<s;
+            }
+            if (!covered) continue;
+            target.stats.covered++;
+            if (!passed) continue;
+
+            // шейдим в точке пикселя, а если она вне треугольника - в первом покрытом сэмпле
+            float px = fx, py = fy;
+            if (!(w[0]>=0 && w[1]>=0 && w[2]>=0)) {
+                int s = 0;
+                while (!(covered & (1<<s))) s++;
+                px += pos[s][0]/16.f;
+                py += pos[s][1]/16.f;
+            }
+            float b1 = (a[1]*px + b[1]*py + c[1]) * inv_area;
+            float b2 = (a[2]*px + b[2]*py + c[2]) * inv_area;
+            TGAColor color = shade_color(t, Vec3f(1.f-b1-b2, b1, b2), target);
+            target.stats.shaded++;
+
+            unsigned int *sc = target.sample_color + idx*S;
+            if (!target.touched[idx]) {
+                unsigned int bg = target.image->get(x, y).val;
+                for (int s=0; s<S; s++) sc[s] = bg;
+                target.touched[idx] = 1;
+            }
+            for (int s=0; s<S; s++) {
+                if (!(passed & (1<<s))) continue;
+                sz[s] = zcenter + (za*pos[s][0] + zb*pos[s][1])/16.f;
+                sc[s] = color.val;
+            }
+        }
+    }
+}
+
+// среднее сэмплов тронутых пикселей тайла -> image, ближайший сэмпл -> zbuffer
+static void msaa_resolve(const TileRect &r, RasterTarget &target) {
+    const int S = target.samples;
+    for (int y=r.y0; y<=r.y1; y++) {
+        for (int x=r.x0; x<=r.x1; x++) {
+            int idx = x + y*target.width;
+            if (!target.touched[idx]) continue;
+            const unsigned int *sc = target.sample_color + idx*S;
+            const float *sz = target.sample_z + idx*S;
+            float z = sz[0];
+            for (int s=1; s<S; s++) z = std::max(z, sz[s]);
+            depth_write(target, idx, z);
+
+            bool same = true;
+            for (int s=1; s<S && same; s++) same = sc[s]==sc[0];
+            TGAColor c(sc[0], 4);
+            if (!same) {
+                int sum[3] = {0, 0, 0};
+                for (int s=0; s<S; s++)
+                    for (int k=0; k<3; k++) sum[k] += (sc[s] >> (8*k)) & 0xff;
+                for (int k=0; k<3; k++) c.raw[k] = (unsigned char)((sum[k] + S/2) / S);
+            }
+            target.image->set(x, y, c);
+        }
+    }
+}
+
+// дальше этой границы (в пикселях) произведения рёбер могут не влезть в int64
+static const float SUBPIXEL_RANGE = float(1 << 20);
+
+void triangle_fixed(const RasterTriangle &t, const TileRect &r, RasterTarget &target) {
+    int width = target.width;
+
+    long long X[3], Y[3];
+    float Z[3];
+    for (int i=0; i<3; i++) {
+        const Vec3f &v = t.screen[i];
+        // вершины за камерой дают огромные координаты, такой треугольник не рисуем
+        if (!(std::fabs(v.x)<SUBPIXEL_RANGE && std::fabs(v.y)<SUBPIXEL_RANGE)) return;
+        X[i] = std::llround(v.x * SUBPIXEL_ONE);
+        Y[i] = std::llround(v.y * SUBPIXEL_ONE);
+        Z[i] = v.z;
+    }
+
+    long long area = (X[1]-X[0])*(Y[2]-Y[0]) - (Y[1]-Y[0])*(X[2]-X[0]);
+    if (area==0) return;
+    long long sign = area>0 ? 1 : -1;
+
+    // пиксель (x,y) - точка (x*16, y*16); bbox по вершинам в субпикселях.
+    // сдвиг вправо отрицательного - арифметический, т.е. деление с округлением вниз
+    long long xlo = std::min(X[0], std::min(X[1], X[2]));
+    long long ylo = std::min(Y[0], std::min(Y[1], Y[2]));
+    long long xhi = std::max(X[0], std::max(X[1], X[2]));
+    long long yhi = std::max(Y[0], std::max(Y[1], Y[2]));
+    // x, y ниже - пиксели кадра, в буфер окна - со сдвигом на его начало
+    int ox = target.origin_x, oy = target.origin_y;
+    int xmin = std::max<long long>(r.x0 + ox, (xlo + SUBPIXEL_ONE-1) >> SUBPIXEL_BITS);
+    int ymin = std::max<long long>(r.y0 + oy, (ylo + SUBPIXEL_ONE-1) >> SUBPIXEL_BITS);
+    int xmax = std::min<long long>(r.x1 + ox, xhi >> SUBPIXEL_BITS);
+    int ymax = std::min<long long>(r.y1 + oy, yhi >> SUBPIXEL_BITS);
+    if (xmin>xmax || ymin>ymax) return;
+
+    // w_i = a_i*x + b_i*y + c_i в субпикселях, ориентация приведена к area>0.
+    // top-left: ребро с a>0 или (a==0 и b<0) включает точки с w==0, остальные - нет.
+    // у соседнего треугольника то же ребро идёт с обратным знаком, поэтому
+    // пиксель на ребре получает ровно один из них
+    long long a[3], b[3], bias[3], w_row[3];
+    for (int i=0; i<3; i++) {
+        int p = (i+1)%3, q = (i+2)%3;
+        a[i] = sign * (Y[p] - Y[q]);
+        b[i] = sign * (X[q] - X[p]);
+        long long c = sign * (X[p]*Y[q] - Y[p]*X[q]);
+        bias[i] = (a[i]>0 || (a[i]==0 && b[i]<0)) ? 0 : 1;
+        // коэффициенты бывают отрицательными, сдвиг влево для них - UB, поэтому умножение
+        w_row[i] = a[i]*((long long)xmin * SUBPIXEL_ONE) + b[i]*((long long)ymin * SUBPIXEL_ONE) + c - bias[i];
+        a[i] *= SUBPIXEL_ONE;
+        b[i] *= SUBPIXEL_ONE;
+    }
+    float inv_area = 1.f / float(sign*area);
+
+    for (int y=ymin; y<=ymax; y++) {
+        long long w[3] = { w_row[0], w_row[1], w_row[2] };
+        for (int x=xmin; x<=xmax; x++) {
+            if ((w[0] | w[1] | w[2]) >= 0) {
+                target.stats.covered++;
+                float b1 = float(w[1] + bias[1]) * inv_area;
+                float b2 = float(w[2] + bias[2]) * inv_area;
+                Vec3f bc(1.f-b1-b2, b1, b2);
+                float z = Z[0]*bc.x + Z[1]*bc.y + Z[2]*bc.z;
+                int idx = (x-ox) + (y-oy)*width;
+                if (depth_less(target, idx, z)) {
+                    depth_write(target, idx, z);
+                    target.stats.shaded++;
+                    shade(t, bc, x-ox, y-oy, target);
+                }
+            }
+            for (int i=0; i<3; i++) w[i] += a[i];
+        }
+        for (int i=0; i<3; i++) w_row[i] += b[i];
+    }
+}
+
+Rasterizer::Rasterizer(int w, int h) : width_(w), height_(h),
+    tiles_x_((w+TILE_SIZE-1)/TILE_SIZE), tiles_y_((h+TILE_SIZE-1)/TILE_SIZE),
+    threads_(1), mode_(RASTER_BARYCENTRIC), hiz_enabled_(false), deferred_(false), zbuffer_(NULL),
+    depth_format_(DEPTH_32F), depth_near_(0), depth_scale_(1), epoch_(0), tile_epoch_(tiles_x_*tiles_y_, 0),
+    hiz_width_((w+HIZ_BLOCK-1)/HIZ_BLOCK), hiz_height_((h+HIZ_BLOCK-1)/HIZ_BLOCK),
+    hiz8_(hiz_width_*hiz_height_), hiz64_(tiles_x_*tiles_y_), msaa_(1), vrs_(NULL), front_to_back_(false),
+    micro_batch_(false), bins_(tiles_x_*tiles_y_), origin_x_(0), origin_y_(0) {
+    set_threads(0);
+    set_depth_format(DEPTH_32F);
+}
+
+Rasterizer::~Rasterizer() {
+    delete [] zbuffer_;
+}
+
+void Rasterizer::clear() {
+    epoch_++;
+}
+
+void Rasterizer::clear_tile(int tile, RasterStats &stats) {
+    if (tile_epoch_[tile]==epoch_) return;
+    tile_epoch_[tile] = epoch_;
+
+    const float zfar = -std::numeric_limits<float>::max();
+    TileRect r = tile_rect(tile);
+    int n = r.x1 - r.x0 + 1;
+    for (int y=r.y0; y<=r.y1; y++) {
+        int row = r.x0 + y*width_;
+        if (zbuffer_) std::fill(zbuffer_ + row, zbuffer_ + row + n, zfar);
+        if (!zbuffer16_.empty()) std::fill(zbuffer16_.begin() + row, zbuffer16_.begin() + row + n, 0);
+        if (!zbuffer24_.empty()) std::fill(zbuffer24_.begin() + row, zbuffer24_.begin() + row + n, 0);
+        if (!sample_z_.empty())
+            std::fill(sample_z_.begin() + row*msaa_, sample_z_.begin() + (row + n)*msaa_, zfar);
+    }
+    stats.depth_cleared += (long long)n * (r.y1 - r.y0 + 1) * depth_bytes() / (width_*height_);
+
+    for (int by=r.y0/HIZ_BLOCK; by<=r.y1/HIZ_BLOCK; by++)
+        for (int bx=r.x0/HIZ_BLOCK; bx<=r.x1/HIZ_BLOCK; bx++) hiz8_[bx + by*hiz_width_] = zfar;
+    hiz64_[tile] = zfar;
+}
+
+float *Rasterizer::zbuffer() {
+    RasterStats unused;
+    for (int tile=0; tile<(int)tile_epoch_.size(); tile++) clear_tile(tile, unused);
+    return zbuffer_;
+}
+
+void Rasterizer::set_depth_format(DepthFormat format, float znear, float zfar) {
+    depth_format_ = format;
+    delete [] zbuffer_;
+    zbuffer_ = format==DEPTH_32F ? new float[width_*height_] : NULL;
+    zbuffer16_.clear();
+    zbuffer24_.clear();
+    if (format==DEPTH_16) zbuffer16_.resize(width_*height_);
+    if (format==DEPTH_24) zbuffer24_.resize(width_*height_);
+    depth_near_  = znear;
+    depth_scale_ = zfar>znear ? (format==DEPTH_16 ? 65535.f : 16777215.f) / (zfar - znear) : 1.f;
+    std::fill(tile_epoch_.begin(), tile_epoch_.end(), 0);
+    clear();
+}
+
+size_t Rasterizer::depth_bytes() const {
+    size_t texel = depth_format_==DEPTH_16 ? sizeof(unsigned short) :
+                   depth_format_==DEPTH_24 ? sizeof(unsigned int) : sizeof(float);
+    return (texel + msaa_*sizeof(float)*(msaa_>1)) * width_ * height_;
+}
+
+void Rasterizer::set_msaa(int samples) {
+    msaa_ = (samples==4 || samples==8) ? samples : 1;
+    if (msaa_==1) {
+        sample_z_.clear();
+        sample_color_.clear();
+        touched_.clear();
+        return;
+    }
+    sample_z_.assign(width_*height_*msaa_, -std::numeric_limits<float>::max());
+    sample_color_.resize(width_*height_*msaa_);
+    touched_.resize(width_*height_);
+}
+
+RasterTarget Rasterizer::make_target(Model &model, TGAImage &image) {
+    RasterTarget target;
+    target.model   = &model;
+    target.image   = &image;
+    target.zbuffer = zbuffer_;
+    target.zbuffer16 = zbuffer16_.empty() ? NULL : &zbuffer16_[0];
+    target.zbuffer24 = zbuffer24_.empty() ? NULL : &zbuffer24_[0];
+    target.depth_format = depth_format_;
+    target.depth_near  = depth_near_;
+    target.depth_scale = depth_scale_;
+    target.width   = width_;
+    target.height  = height_;
+    target.origin_x = origin_x_;
+    target.origin_y = origin_y_;
+    target.hiz     = hiz_enabled_ && msaa_==1 ? &hiz8_[0] : NULL;
+    target.hiz_width = hiz_width_;
+    target.vis_id  = NULL;
+    target.vis_bc  = NULL;
+    target.tri_id  = -1;
+    target.samples = msaa_;
+    target.sample_z     = msaa_>1 ? &sample_z_[0] : NULL;
+    target.sample_color = msaa_>1 ? &sample_color_[0] : NULL;
+    target.touched      = msaa_>1 ? &touched_[0] : NULL;
+    target.vrs     = msaa_==1 ? vrs_ : NULL;
+    if (deferred_ && msaa_==1 && !vrs_) {
+        vis_id_.resize(width_*height_);
+        vis_bc_.resize(width_*height_);
+        target.vis_id = &vis_id_[0];
+        target.vis_bc = &vis_bc_[0];
+    }
+    return target;
+}
+
+// n<=0: по числу ядер
+void Rasterizer::set_threads(int n) {
+    if (n<=0) n = (int)std::thread::hardware_concurrency();
+    threads_ = std::max(1, n);
+}
+
+TileRect Rasterizer::tile_rect(int tile) const {
+    TileRect r;
+    r.x0 = (tile % tiles_x_) * TILE_SIZE;
+    r.y0 = (tile / tiles_x_) * TILE_SIZE;
+    r.x1 = std::min(r.x0 + TILE_SIZE, width_)  - 1;
+    r.y1 = std::min(r.y0 + TILE_SIZE, height_) - 1;
+    return r;
+}
+
+void Rasterizer::draw_tile(const std::vector<RasterTriangle> &tris, int tile,
+                           TriangleFunc kernel, RasterTarget &target) {
+    TileRect r = tile_rect(tile);
+    const std::vector<int> &bin = bins_[tile];
+    if (bin.empty()) return;
+    if (target.vis_id)
+        for (int y=r.y0; y<=r.y1; y++)
+            std::fill(target.vis_id + r.x0 + y*width_, target.vis_id + r.x1+1 + y*width_, -1);
+    if (target.touched)
+        for (int y=r.y0; y<=r.y1; y++)
+            std::fill(target.touched + r.x0 + y*width_, target.touched + r.x1+1 + y*width_, 0);
+
+    if (!target.hiz) {
+        // мелкие треугольники копятся в пакет, пакет сбрасывается перед
+        // крупным треугольником, так что порядок внутри тайла сохраняется
+        bool micro = micro_batch_ && kernel==triangle_edge;
+        int batch[MICRO_BATCH], nbatch = 0;
+        for (size_t i=0; i<bin.size(); i++) {
+            if (micro && micro_[bin[i]]) {
+                batch[nbatch++] = bin[i];
+                if (nbatch==MICRO_BATCH) {
+                    triangle_micro(tris, batch, nbatch, r, target);
+                    nbatch = 0;
+                }
+                continue;
+            }
+            if (nbatch) {
+                triangle_micro(tris, batch, nbatch, r, target);
+                nbatch = 0;
+            }
+            target.tri_id = bin[i];
+            kernel(tris[bin[i]], r, target);
+        }
+        if (nbatch) triangle_micro(tris, batch, nbatch, r, target);
+    } else {
+        draw_tile_hiz(tris, tile, kernel, target);
+    }
+
+    if (target.vis_id) resolve(tris, r, target);
+    if (target.touched) msaa_resolve(r, target);
+}
+
+void Rasterizer::draw_tile_hiz(const std::vector<RasterTriangle> &tris, int tile,
+                               TriangleFunc kernel, RasterTarget &target) {
+    TileRect r = tile_rect(tile);
+    const std::vector<int> &bin = bins_[tile];
+    // ядра на rasterize_edges проверяют и обновляют блоки Hi-Z сами, остальным
+    // блоки bbox проверяются здесь, а обновляются после треугольника
+    bool kernel_keeps_hiz = kernel==triangle_edge || kernel==triangle_vrs;
+
+    float &tile_z = hiz64_[tile];
+    for (size_t i=0; i<bin.size(); i++) {
+        const RasterTriangle &t = tris[bin[i]];
+        float z = nearest_z(t);
+        if (z <= tile_z) {
+            target.stats.hiz_tiles++;
+            continue;
+        }
+        target.tri_id = bin[i];
+        long long shaded = target.stats.shaded;
+        if (kernel_keeps_hiz) {
+            kernel(t, r, target);
+            if (target.stats.shaded==shaded) continue;
+        } else {
+            int bx0 = std::max(r.x0, std::min(t.pts[0].x, std::min(t.pts[1].x, t.pts[2].x)) - origin_x_) / HIZ_BLOCK;
+            int by0 = std::max(r.y0, std::min(t.pts[0].y, std::min(t.pts[1].y, t.pts[2].y)) - origin_y_) / HIZ_BLOCK;
+            int bx1 = std::min(r.x1, std::max(t.pts[0].x, std::max(t.pts[1].x, t.pts[2].x)) - origin_x_) / HIZ_BLOCK;
+            int by1 = std::min(r.y1, std::max(t.pts[0].y, std::max(t.pts[1].y, t.pts[2].y)) - origin_y_) / HIZ_BLOCK;
+            // ядро зовётся на отрезки строки блоков между отброшенными блоками;
+            // пиксели считаются независимо от прямоугольника, так что картинка та же
+            for (int by=by0; by<=by1; by++) {
+                for (int bx=bx0; bx<=bx1; ) {
+                    if (z <= hiz8_[bx + by*hiz_width_]) {
+                        target.stats.hiz_blocks++;
+                        bx++;
+                        continue;
+                    }
+                    int end = bx;
+                    while (end+1<=bx1 && z > hiz8_[end+1 + by*hiz_width_]) end++;
+                    TileRect span = { std::max(r.x0, bx*HIZ_BLOCK), std::max(r.y0, by*HIZ_BLOCK),
+                                      std::min(r.x1, end*HIZ_BLOCK + HIZ_BLOCK-1),
+                                      std::min(r.y1, by*HIZ_BLOCK + HIZ_BLOCK-1) };
+                    kernel(t, span, target);
+                    bx = end+1;
+                }
+            }
+            if (target.stats.shaded==shaded) continue;
+            for (int by=by0; by<=by1; by++)
+                for (int bx=bx0; bx<=bx1; bx++) hiz_refresh(target, bx, by);
+        }
+        // второй уровень пирамиды - минимум блоков тайла
+        float zmin = std::numeric_limits<float>::max();
+        for (int by=r.y0/HIZ_BLOCK; by<=r.y1/HIZ_BLOCK; by++)
+            for (int bx=r.x0/HIZ_BLOCK; bx<=r.x1/HIZ_BLOCK; bx++)
+                zmin = std::min(zmin, hiz8_[bx + by*hiz_width_]);
+        tile_z = zmin;
+    }
+}
+
+void Rasterizer::draw(const std::vector<RasterTriangle> &tris, Model &model, TGAImage &image) {
+    bin(tris);
+
+    TriangleFunc kernel = triangle;
+    if (mode_==RASTER_EDGE)  kernel = triangle_edge;
+    if (mode_==RASTER_FIXED) kernel = triangle_fixed;
+    if (vrs_) kernel = triangle_vrs;
+    if (msaa_>1) kernel = triangle_msaa;
+
+    run_tiles(model, image, [&](int tile, RasterTarget &target) {
+        draw_tile(tris, tile, kernel, target);
+    });
+}
@@ -0,0 +1,523 @@
+// rasterizer.h
+#ifndef __RASTERIZER_H__
+#define __RASTERIZER_H__
+
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "model.h"
+#include "simd.h"
+
+struct RasterLine;
+struct VertexBuffer;
+class PrimitiveStage;
+
+// треугольник после setup: экранные вершины, uv и освещённость грани
+struct RasterTriangle {
+    Vec3i pts[3];    // округлённые до пикселя
+    Vec3f screen[3]; // до округления, для субпиксельного режима
+    Vec2f uvs[3];
+    float intensity;
+};
+
+// прямоугольник пикселей, границы включительно
+struct TileRect {
+    int x0, y0, x1, y1;
+};
+
+enum RasterMode {
+    RASTER_BARYCENTRIC, // barycentric() на каждый пиксель
+    RASTER_EDGE,        // инкрементальные рёберные функции, блоки 8x8, 8 пикселей за раз
+    RASTER_FIXED        // вершины в 28.4, целочисленные рёбра, правило top-left
+};
+
+struct RasterStats {
+    long long covered; // фрагменты, прошедшие тест покрытия
+    long long shaded;  // фрагменты, прошедшие z-тест
+    long long resolved; // вызовы diffuse во втором проходе отложенного режима
+    long long coarse;   // вызовы diffuse в режиме VRS
+    long long hiz_tiles;  // пары треугольник-тайл, отброшенные Hi-Z
+    long long hiz_blocks; // блоки 8x8, отброшенные Hi-Z
+    long long micro;         // пары треугольник-тайл в пакетах мелких треугольников
+    long long micro_batches; // пакеты мелких треугольников
+    long long depth_cleared; // байт глубины, очищенных при первом касании тайлов
+    long long line_pixels;   // нарисованные пиксели линий
+    long long line_hidden;   // пиксели линий, отброшенные z-тестом
+
+    RasterStats() : covered(0), shaded(0), resolved(0), coarse(0), hiz_tiles(0), hiz_blocks(0),
+        micro(0), micro_batches(0), depth_cleared(0), line_pixels(0), line_hidden(0) {}
+    RasterStats & operator +=(const RasterStats &s) {
+        covered += s.covered;
+        shaded  += s.shaded;
+        resolved += s.resolved;
+        coarse   += s.coarse;
+        hiz_tiles  += s.hiz_tiles;
+        hiz_blocks += s.hiz_blocks;
+        micro += s.micro;
+        micro_batches += s.micro_batches;
+        depth_cleared += s.depth_cleared;
+        line_pixels += s.line_pixels;
+        line_hidden += s.line_hidden;
+        return *this;
+    }
+};
+
+// Hi-Z: для каждого блока 8x8 хранится самая дальняя глубина блока,
+// т.е. минимум zbuffer (ближе к камере = больше z)
+static const int HIZ_BLOCK = 8;
+// запас на ошибку округления барицентрик, при z до 255 её на порядки меньше
+static const float HIZ_EPSILON = 1e-3f;
+
+// порядок треугольников по убыванию depth (ближние первыми): глубина квантуется
+// в 16 бит, два прохода поразрядной сортировки по 8 бит, порядок равных сохраняется
+void sort_front_to_back(const std::vector<float> &depth, std::vector<int> &order);
+
+// VRS: для треугольника выбирает размер ячейки шейдинга, log2: 0 - 1x1, 1 - 2x2, 2 - 4x4
+typedef int (*VrsPolicy)(const RasterTriangle &t, Model &model);
+
+int vrs_2x2(const RasterTriangle &t, Model &model);
+int vrs_4x4(const RasterTriangle &t, Model &model);
+// по плотности текселей: чем сильнее текстура растянута по экрану, тем крупнее ячейка
+int vrs_texel_density(const RasterTriangle &t, Model &model);
+
+// формат буфера глубины; 16 и 24 бит - беззнаковое целое, линейное по z в
+// диапазоне set_depth_format(), 0 - очищено. 24 бита лежат в 32-битном слове
+// (как D24X8), так что выигрыш по памяти даёт только 16-битный формат
+enum DepthFormat { DEPTH_32F, DEPTH_24, DEPTH_16 };
+
+// куда пишет один поток внутри своего тайла; указатели общие, статистика своя
+struct RasterTarget {
+    Model *model;
+    TGAImage *image;
+    float *zbuffer;                 // DEPTH_32F, иначе NULL
+    unsigned short *zbuffer16;      // DEPTH_16
+    unsigned int *zbuffer24;        // DEPTH_24
+    DepthFormat depth_format;
+    float depth_near, depth_scale;  // q = (z - depth_near)*depth_scale
+    int width, height;
+    // окно кадра: пиксель буфера (x, y) - точка кадра (x+origin_x, y+origin_y).
+    // Треугольники остаются в координатах кадра, и рёбра, z и барицентрики считаются
+    // в точке кадра: окно совпадает с тем же местом полного кадра до бита
+    int origin_x, origin_y;
+    float *hiz;     // минимумы zbuffer по блокам 8x8, NULL - Hi-Z выключен
+    int hiz_width;  // блоков в строке
+    int *vis_id;    // буфер видимости: номер треугольника, NULL - шейдинг сразу
+    Vec3f *vis_bc;  // и его барицентрики в пикселе
+    int tri_id;     // номер текущего треугольника в tris
+    int samples;    // MSAA: сэмплов на пиксель, 1 - выключено
+    float *sample_z;             // глубина каждого сэмпла, samples на пиксель
+    unsigned int *sample_color;  // цвет сэмпла (TGAColor::val)
+    unsigned char *touched;      // пиксель уже трогали в этом draw()
+    VrsPolicy vrs;  // NULL - шейдинг в каждом пикселе
+    RasterStats stats;
+};
+
+// z -> значение 16/24-битного буфера с округлением, не меньше 1
+inline unsigned int depth_quantize(const RasterTarget &t, float z) {
+    float qmax = t.depth_format==DEPTH_16 ? 65535.f : 16777215.f;
+    float q = (z - t.depth_near)*t.depth_scale + .5f;
+    if (!(q>=1.f)) return 1;
+    if (q>qmax) return (unsigned int)qmax;
+    return (unsigned int)q;
+}
+
+// в буфере idx лежит глубина дальше z (z-тест пройдёт)
+inline bool depth_less(const RasterTarget &t, int idx, float z) {
+    if (t.depth_format==DEPTH_16) return t.zbuffer16[idx] < depth_quantize(t, z);
+    if (t.depth_format==DEPTH_24) return t.zbuffer24[idx] < depth_quantize(t, z);
+    return t.zbuffer[idx] < z;
+}
+
+inline void depth_write(RasterTarget &t, int idx, float z) {
+    if (t.depth_format==DEPTH_16)      t.zbuffer16[idx] = (unsigned short)depth_quantize(t, z);
+    else if (t.depth_format==DEPTH_24) t.zbuffer24[idx] = depth_quantize(t, z);
+    else t.zbuffer[idx] = z;
+}
+
+// наибольшее z, которое в буфере idx не пройдёт z-тест (для Hi-Z)
+float depth_floor(const RasterTarget &t, int idx);
+
+// ближайшая к камере глубина треугольника с запасом на ошибку интерполяции:
+// если она не больше дальней глубины блока, ни один пиксель блока не пройдёт z-тест
+float nearest_z(const RasterTriangle &t);
+
+// пересчитать минимум zbuffer для блока 8x8 с номером (bx, by)
+void hiz_refresh(RasterTarget &target, int bx, int by);
+
+typedef void (*TriangleFunc)(const RasterTriangle &t, const TileRect &r, RasterTarget &target);
+
+// эталонный растеризатор: barycentric() для каждого пикселя bbox,
+// обрезанного по прямоугольнику r
+void triangle(const RasterTriangle &t, const TileRect &r, RasterTarget &target);
+
+// рёберный растеризатор (rasterize_edges) с шейдингом diffuse * intensity
+void triangle_edge(const RasterTriangle &t, const TileRect &r, RasterTarget &target);
+
+// VRS: покрытие и z-тест попиксельно (rasterize_edges), а diffuse - один раз
+// на ячейку 2x2 или 4x4 в центре ячейки, размер выбирает target.vrs
+void triangle_vrs(const RasterTriangle &t, const TileRect &r, RasterTarget &target);
+
+// MSAA 4x/8x: покрытие и z-тест для каждого сэмпла по t.screen, diffuse -
+// один раз на пиксель, цвет пишется во все прошедшие сэмплы; картинку
+// собирает msaa_resolve() после тайла
+void triangle_msaa(const RasterTriangle &t, const TileRect &r, RasterTarget &target);
+
+// 28.4: 4 бита дробной части, пиксель = 16 единиц
+static const int SUBPIXEL_BITS = 4;
+static const int SUBPIXEL_ONE  = 1 << SUBPIXEL_BITS;
+
+// вершины t.screen снэпятся к сетке 1/16 пикселя, рёбра считаются в int64;
+// пиксель на общем ребре двух треугольников достаётся ровно одному из них
+void triangle_fixed(const RasterTriangle &t, const TileRect &r, RasterTarget &target);
+
+// мелкий треугольник: bbox не больше MICRO_SIZE x MICRO_SIZE пикселей
+static const int MICRO_SIZE  = 4;
+static const int MICRO_BATCH = 8; // треугольников в пакете = ширина Float8
+
+// рёберный растеризатор для пакета мелких треугольников: покрытие всех
+// MICRO_SIZE*MICRO_SIZE пикселей bbox считается сразу для n<=MICRO_BATCH
+// треугольников (треугольник на дорожку Float8), z-тест и шейдинг - по
+// порядку треугольников, результат совпадает с triangle_edge
+void triangle_micro(const std::vector<RasterTriangle> &tris, const int *ids, int n,
+                    const TileRect &r, RasterTarget &target);
+
+class Rasterizer {
+public:
+    static const int TILE_SIZE = 64;
+
+    Rasterizer(int w, int h);
+    ~Rasterizer();
+
+    // zbuffer и Hi-Z = -max; ничего не пишет, только начинает новую эпоху -
+    // тайл очищается при первом касании в ней (или в zbuffer())
+    void clear();
+    void set_threads(int n);
+    int threads() const { return threads_; }
+    void set_mode(RasterMode m) { mode_ = m; }
+    void set_hiz(bool enable) { hiz_enabled_ = enable; }
+    // отложенный шейдинг: сначала в тайле пишутся только z, номер треугольника и
+    // барицентрики, затем каждый видимый пиксель тайла шейдится один раз
+    void set_deferred(bool enable) { deferred_ = enable; }
+    // 4 или 8 сэмплов на пиксель, 1 - выключить; вместе с MSAA Hi-Z и
+    // отложенный режим не используются
+    void set_msaa(int samples);
+    // крупный шейдинг (VRS), NULL - выключить; с MSAA не сочетается
+    void set_vrs(VrsPolicy policy) { vrs_ = policy; }
+    // перед раскладкой по тайлам треугольники сортируются спереди назад, чтобы
+    // z-тест отбрасывал больше фрагментов до шейдинга; пиксели общих рёбер, которые
+    // без 28.4 (top-left) закрашивают обе грани, достаются уже другой из них
+    void set_front_to_back(bool enable) { front_to_back_ = enable; }
+    // мелкие треугольники растеризуются пакетами по MICRO_BATCH (только RASTER_EDGE
+    // без Hi-Z, VRS и MSAA)
+    void set_micro_batch(bool enable) { micro_batch_ = enable; }
+    // формат и диапазон z для квантования 16/24 бит; буфер очищается
+    void set_depth_format(DepthFormat format, float znear = 0.f, float zfar = 255.f);
+    DepthFormat depth_format() const { return depth_format_; }
+    size_t depth_bytes() const; // размер буфера глубины
+    // окно кадра: буферы и image размером w x h из конструктора, а треугольники и
+    // отрезки в координатах полного кадра; (x, y) - левый нижний угол окна.
+    // Всё, что не попало в окно, отбрасывается при раскладке по тайлам, тайлы
+    // и блоки Hi-Z - в координатах окна
+    void set_origin(int x, int y) { origin_x_ = x; origin_y_ = y; }
+    // дочищает тайлы, не тронутые с последнего clear(); NULL для 16/24 бит
+    float *zbuffer();
+    const RasterStats &stats() const { return stats_; } // за последний draw()
+
+    // треугольники раскладываются по тайлам, каждый тайл целиком
+    // принадлежит одному потоку, порядок внутри тайла = порядок в tris
+    void draw(const std::vector<RasterTriangle> &tris, Model &model, TGAImage &image);
+
+    // программируемый конвейер: грани model из вершин screen (transform_vertices)
+    // через primitives, vertex() для углов оставшихся граней, затем тайлы через
+    // rasterize_edges и fragment(); face_visible - грани после мешлетов, NULL - все.
+    // Определён в shader.h
+    template <class Shader> void draw_shaded(Shader &shader, const VertexBuffer &screen, PrimitiveStage &primitives,
+                                             Model &model, TGAImage &image, const unsigned char *face_visible = NULL);
+
+    // отрезки раскладываются по тайлам, тайл рисует свою часть каждого;
+    // depth_test - скрытые линии убираются по zbuffer; определён в wireframe.cpp
+    void draw_lines(const std::vector<RasterLine> &lines, Model &model, TGAImage &image,
+                    TGAColor color, bool depth_test);
+
+private:
+    int width_, height_;
+    int tiles_x_, tiles_y_;
+    int threads_;
+    RasterMode mode_;
+    bool hiz_enabled_;
+    bool deferred_;
+    float *zbuffer_;
+    std::vector<unsigned short> zbuffer16_;
+    std::vector<unsigned int> zbuffer24_;
+    DepthFormat depth_format_;
+    float depth_near_, depth_scale_;
+    unsigned int epoch_;                   // увеличивается в clear()
+    std::vector<unsigned int> tile_epoch_; // эпоха, в которой тайл очищен
+    int hiz_width_, hiz_height_;
+    std::vector<float> hiz8_;  // минимумы по блокам 8x8
+    std::vector<float> hiz64_; // минимумы по тайлам 64x64
+    std::vector<int>   vis_id_;
+    std::vector<Vec3f> vis_bc_;
+    int msaa_;
+    VrsPolicy vrs_;
+    bool front_to_back_;
+    std::vector<float> depth_; // для сортировки
+    std::vector<int> order_;
+    bool micro_batch_;
+    std::vector<unsigned char> micro_; // 1 - треугольник мелкий, считается в bin()
+    std::vector<float> sample_z_;
+    std::vector<unsigned int> sample_color_;
+    std::vector<unsigned char> touched_;
+    RasterStats stats_;
+    std::vector<std::vector<int> > bins_; // индексы треугольников по тайлам
+    int origin_x_, origin_y_;
+
+    Rasterizer(const Rasterizer &);
+    Rasterizer & operator =(const Rasterizer &);
+
+    // T - любой треугольник с полем Vec3i pts[3] в координатах кадра
+    template <class T> void bin(const std::vector<T> &tris);
+    RasterTarget make_target(Model &model, TGAImage &image);
+    // раздать тайлы потокам, f(tile, target) вызывается для каждого тайла;
+    // статистика потоков суммируется в stats_
+    template <class F> void run_tiles(Model &model, TGAImage &image, F f);
+    void draw_tile(const std::vector<RasterTriangle> &tris, int tile,
+                   TriangleFunc kernel, RasterTarget &target);
+    void draw_tile_hiz(const std::vector<RasterTriangle> &tris, int tile,
+                       TriangleFunc kernel, RasterTarget &target);
+    TileRect tile_rect(int tile) const;
+    // очистить глубину, Hi-Z и сэмплы тайла, если он ещё не очищен в этой эпохе
+    void clear_tile(int tile, RasterStats &stats);
+};
+
+template <class T>
+void Rasterizer::bin(const std::vector<T> &tris) {
+    for (size_t i=0; i<bins_.size(); i++) bins_[i].clear();
+
+    int n = (int)tris.size();
+    if (front_to_back_) {
+        depth_.resize(n);
+        for (int i=0; i<n; i++) {
+            const Vec3i *pts = tris[i].pts;
+            depth_[i] = std::max(pts[0].z, std::max(pts[1].z, pts[2].z));
+        }
+        sort_front_to_back(depth_, order_);
+    }
+    if (micro_batch_) micro_.assign(n, 0);
+
+    for (int k=0; k<n; k++) {
+        int i = front_to_back_ ? order_[k] : k;
+        const Vec3i *pts = tris[i].pts;
+        int xmin = std::min(pts[0].x, std::min(pts[1].x, pts[2].x)) - origin_x_;
+        int ymin = std::min(pts[0].y, std::min(pts[1].y, pts[2].y)) - origin_y_;
+        int xmax = std::max(pts[0].x, std::max(pts[1].x, pts[2].x)) - origin_x_;
+        int ymax = std::max(pts[0].y, std::max(pts[1].y, pts[2].y)) - origin_y_;
+        if (xmax<0 || ymax<0 || xmin>=width_ || ymin>=height_) continue;
+        if (micro_batch_) micro_[i] = xmax-xmin<MICRO_SIZE && ymax-ymin<MICRO_SIZE;
+
+        int tx0 = std::max(xmin, 0) / TILE_SIZE;
+        int ty0 = std::max(ymin, 0) / TILE_SIZE;
+        int tx1 = std::min(xmax, width_-1)  / TILE_SIZE;
+        int ty1 = std::min(ymax, height_-1) / TILE_SIZE;
+        for (int ty=ty0; ty<=ty1; ty++)
+            for (int tx=tx0; tx<=tx1; tx++)
+                bins_[tx + ty*tiles_x_].push_back(i);
+    }
+}
+
+template <class F>
+void Rasterizer::run_tiles(Model &model, TGAImage &image, F f) {
+    int ntiles = (int)bins_.size();
+    int nthreads = std::min(threads_, ntiles);
+    std::vector<RasterTarget> targets(nthreads, make_target(model, image));
+
+    // тайлы не пересекаются, поэтому запись в image и zbuffer идёт без блокировок
+    std::atomic<int> next(0);
+    auto worker = [&](RasterTarget &target) {
+        for (int tile = next++; tile<ntiles; tile = next++) {
+            if (bins_[tile].empty()) continue;
+            clear_tile(tile, target.stats);
+            f(tile, target);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i=1; i<nthreads; i++) pool.push_back(std::thread(worker, std::ref(targets[i])));
+    worker(targets[0]);
+    for (size_t i=0; i<pool.size(); i++) pool[i].join();
+
+    stats_ = RasterStats();
+    for (int i=0; i<nthreads; i++) stats_ += targets[i].stats;
+}
+
+// подготовка рёбер, общая для rasterize_edges и пакета мелких треугольников
+struct EdgeSetup {
+    int xmin, ymin, xmax, ymax; // bbox, обрезанный по тайлу, в координатах окна
+    int ox, oy; // начало окна: рёбра и z ниже - функции точки кадра (x+ox, y+oy)
+    float a[3], b[3], c[3];
+    float inv_area;
+    float za, zb, zc;
+
+    // pts - в координатах кадра; false - треугольник вырожден или не пересекает r
+    bool init(const Vec3i *pts, const TileRect &r, const RasterTarget &target) {
+        ox = target.origin_x;
+        oy = target.origin_y;
+        xmin = std::max(r.x0, std::min(pts[0].x, std::min(pts[1].x, pts[2].x)) - ox);
+        ymin = std::max(r.y0, std::min(pts[0].y, std::min(pts[1].y, pts[2].y)) - oy);
+        xmax = std::min(r.x1, std::max(pts[0].x, std::max(pts[1].x, pts[2].x)) - ox);
+        ymax = std::min(r.y1, std::max(pts[0].y, std::max(pts[1].y, pts[2].y)) - oy);
+        if (xmin>xmax || ymin>ymax) return false;
+
+        int area = (pts[1].x-pts[0].x)*(pts[2].y-pts[0].y) - (pts[1].y-pts[0].y)*(pts[2].x-pts[0].x);
+        if (area==0) return false;
+        float sign = area>0 ? 1.f : -1.f;
+
+        // w_i(x,y) = a_i*x + b_i*y + c_i - ребро напротив вершины i, w_i(pts[i]) = area.
+        // В guard band координаты от -1024 до 4095, и c_i доходит до ~2^25: считается
+        // в int64 и округляется во float один раз. Значения целые и точны, пока меньше
+        // 2^24 (координаты по модулю меньше 2896, кадр до ~1870 пикселей), дальше
+        // пиксели ровно на ребре могут отойти к соседней грани
+        for (int i=0; i<3; i++) {
+            const Vec3i &p = pts[(i+1)%3];
+            const Vec3i &q = pts[(i+2)%3];
+            a[i] = sign * (p.y - q.y);
+            b[i] = sign * (q.x - p.x);
+            c[i] = sign * float((long long)p.x*q.y - (long long)p.y*q.x);
+        }
+        inv_area = 1.f / (sign*area);
+
+        // глубина тоже линейна по x, y
+        za = 0, zb = 0, zc = 0;
+        for (int i=0; i<3; i++) {
+            za += pts[i].z * a[i] * inv_area;
+            zb += pts[i].z * b[i] * inv_area;
+            zc += pts[i].z * c[i] * inv_area;
+        }
+        return true;
+    }
+};
+
+// рёберные функции считаются один раз на треугольник и шагаются инкрементально,
+// покрытие и z-тест - по 8 пикселей строки блока (simd.h);
+// при включённом Hi-Z блоки 8x8 проверяются и обновляются прямо здесь.
+// frag(x, y, bc) вызывается для фрагмента, прошедшего z-тест, и возвращает
+// false, если фрагмент отброшен - тогда zbuffer не меняется
+template <class Fragment>
+void rasterize_edges(const Vec3i *pts, const TileRect &r, RasterTarget &target, Fragment frag) {
+    float *zbuffer = target.zbuffer;
+    int width = target.width;
+    float zmax = std::max(pts[0].z, std::max(pts[1].z, pts[2].z)) + HIZ_EPSILON;
+
+    EdgeSetup e;
+    if (!e.init(pts, r, target)) return;
+    const float *a = e.a, *b = e.b, *c = e.c;
+    float inv_area = e.inv_area, za = e.za, zb = e.zb, zc = e.zc;
+    int xmin = e.xmin, ymin = e.ymin, xmax = e.xmax, ymax = e.ymax;
+    int ox = e.ox, oy = e.oy;
+
+    const Float8 zero(0.f);
+    const Float8 ramp = Float8::ramp();
+    const float qmax = target.depth_format==DEPTH_16 ? 65535.f : 16777215.f;
+    float w1s[8], w2s[8], zs[8], ztmp[8];
+
+    // обход bbox блоками 8x8 окна: блок целиком снаружи ребра отбрасывается,
+    // целиком внутри всех рёбер - пиксели не проверяются. Блоки и буферы - в
+    // координатах окна, рёбра и z - в точке кадра (+ox, +oy)
+    for (int by = ymin & ~7; by<=ymax; by += 8) {
+        for (int bx = xmin & ~7; bx<=xmax; bx += 8) {
+            bool full = true, reject = false;
+            for (int i=0; i<3 && !reject; i++) {
+                float w = a[i]*(bx+ox) + b[i]*(by+oy) + c[i];
+                float wmax = w + 7*std::max(a[i], 0.f) + 7*std::max(b[i], 0.f);
+                float wmin = w + 7*std::min(a[i], 0.f) + 7*std::min(b[i], 0.f);
+                if (wmax<0) reject = true;
+                if (wmin<0) full = false;
+            }
+            if (reject) continue;
+
+            float *hiz = NULL;
+            if (target.hiz) {
+                hiz = target.hiz + bx/HIZ_BLOCK + (by/HIZ_BLOCK)*target.hiz_width;
+                // ближайшая точка плоскости z в углах блока, но не ближе вершин
+                float z00 = za*(bx+ox) + zb*(by+oy) + zc;
+                float zblock = z00 + 7*std::max(za, 0.f) + 7*std::max(zb, 0.f) + HIZ_EPSILON;
+                if (std::min(zblock, zmax) <= *hiz) {
+                    target.stats.hiz_blocks++;
+                    continue;
+                }
+            }
+            bool written = false;
+
+            int xmask = 0xff;
+            for (int i=0; i<8; i++)
+                if (bx+i<xmin || bx+i>xmax) xmask &= ~(1<<i);
+
+            Float8 X = Float8(float(bx+ox)) + ramp;
+            Float8 w0x = Float8(a[0]) * X + Float8(c[0]);
+            Float8 w1x = Float8(a[1]) * X + Float8(c[1]);
+            Float8 w2x = Float8(a[2]) * X + Float8(c[2]);
+            Float8 zx  = Float8(za) * X + Float8(zc);
+            bool inside_row = bx+8<=width;
+
+            for (int y = std::max(by, ymin); y<=std::min(by+7, ymax); y++) {
+                Float8 fy = Float8(float(y+oy));
+                Float8 w1 = w1x + Float8(b[1]) * fy;
+                Float8 w2 = w2x + Float8(b[2]) * fy;
+                int m = xmask;
+                if (!full) {
+                    Float8 w0 = w0x + Float8(b[0]) * fy;
+                    m &= ((w0>=zero) & (w1>=zero) & (w2>=zero)).movemask();
+                    if (!m) continue;
+                }
+                target.stats.covered += popcount8(m);
+
+                Float8 z = zx + Float8(zb) * fy;
+                float *zrow = zbuffer ? zbuffer + bx + y*width : NULL;
+                if (zrow) {
+                    Float8 zold;
+                    if (inside_row) {
+                        zold = Float8::load(zrow);
+                    } else {
+                        for (int i=0; i<8; i++) ztmp[i] = bx+i<width ? zrow[i] : 0.f;
+                        zold = Float8::load(ztmp);
+                    }
+                    m &= (zold < z).movemask();
+                    z.store(zs);
+                } else if (inside_row) {
+                    // 16/24 бит: trunc(q) > old <=> q >= old+1, q как в depth_quantize
+                    int idx = bx + y*width;
+                    Float8 qold = target.zbuffer16 ? Float8::load_u16(target.zbuffer16 + idx)
+                                                   : Float8::load_u32(target.zbuffer24 + idx);
+                    Float8 q = (z - Float8(target.depth_near)) * Float8(target.depth_scale) + Float8(.5f);
+                    q = min(max(q, Float8(1.f)), Float8(qmax));
+                    m &= (q >= qold + Float8(1.f)).movemask();
+                    z.store(zs);
+                } else {
+                    z.store(zs);
+                    for (int i=0; i<8; i++)
+                        if ((m & (1<<i)) && !depth_less(target, bx+i + y*width, zs[i])) m &= ~(1<<i);
+                }
+                if (!m) continue;
+
+                w1.store(w1s);
+                w2.store(w2s);
+                for (int i=0; i<8; i++) {
+                    if (!(m & (1<<i))) continue;
+                    float b1 = w1s[i]*inv_area;
+                    float b2 = w2s[i]*inv_area;
+                    if (!frag(bx+i, y, Vec3f(1.f-b1-b2, b1, b2))) continue;
+                    if (zrow) zrow[i] = zs[i];
+                    else depth_write(target, bx+i + y*width, zs[i]);
+                    target.stats.shaded++;
+                    written = true;
+                }
+            }
+            if (hiz && written) hiz_refresh(target, bx/HIZ_BLOCK, by/HIZ_BLOCK);
+        }
+    }
+}
+
+#endif // __RASTERIZER_H__
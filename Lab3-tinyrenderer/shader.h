@@ -0,0 +1,204 @@
+// shader.h
+#ifndef __SHADER_H__
+#define __SHADER_H__
+
+#include <cmath>
+#include <algorithm>
+#include "rasterizer.h"
+#include "primitive.h"
+#include "vertex.h"
+#include "model.h"
+
+// Шейдер - любой класс вида
+//
+//   struct MyShader {
+//       struct Varyings { ... };  // атрибуты вершины, нужны operator+ и operator*(float)
+//       void vertex(int iface, int nthvert, Varyings &out); // атрибуты угла грани
+//       bool fragment(const Varyings &in, TGAColor &color) const; // false - отбросить
+//   };
+//
+// Позиции шейдер не считает: их один раз на вершину даёт вершинная стадия (vertex.h),
+// отсечение, guard band и отбраковку делает PrimitiveStage, как в ручном пути.
+// Rasterizer::draw_shaded(shader, ...) инстанцируется под конкретный шейдер, поэтому обе
+// стадии встраиваются в цикл растеризации без виртуальных вызовов.
+// fragment() вызывается из нескольких потоков одновременно; в отложенном режиме
+// он вызывается уже после z-теста, и отброшенный фрагмент z не откатывает.
+
+template <class Varyings>
+struct ShadedTriangle {
+    Vec3i pts[3];
+    Varyings vary[3];
+};
+
+template <class Varyings>
+inline Varyings interpolate(const Varyings *v, const Vec3f &bc) {
+    return v[0]*bc.x + v[1]*bc.y + v[2]*bc.z;
+}
+
+// общее для стандартных шейдеров: модель и свет
+struct ShaderBase {
+    Model *model;
+    Vec3f light_dir; // куда светит, как в main
+
+    ShaderBase(Model *m, const Vec3f &l) : model(m), light_dir(l) {}
+};
+
+inline TGAColor scale_color(TGAColor c, float k) {
+    c.r *= k;
+    c.g *= k;
+    c.b *= k;
+    return c;
+}
+
+// как ручной путь в triangle(): diffuse * освещённость грани
+struct FlatShader : ShaderBase {
+    struct Varyings {
+        Vec2f uv;
+        float intensity;
+
+        Varyings operator +(const Varyings &v) const { Varyings r; r.uv = uv+v.uv; r.intensity = intensity+v.intensity; return r; }
+        Varyings operator *(float f) const { Varyings r; r.uv = uv*f; r.intensity = intensity*f; return r; }
+    };
+
+    FlatShader(Model *m, const Vec3f &l) : ShaderBase(m, l) {}
+
+    void vertex(int iface, int nthvert, Varyings &out) {
+        out.intensity = std::max(0.f, model->face_normal(iface)*light_dir);
+        out.uv = model->uv(model->face_uv(iface)[nthvert]);
+    }
+
+    bool fragment(const Varyings &in, TGAColor &color) const {
+        color = scale_color(model->diffuse(in.uv), in.intensity);
+        return true;
+    }
+};
+
+// освещённость по нормалям vn в вершинах, интерполируется по треугольнику
+struct GouraudShader : ShaderBase {
+    struct Varyings {
+        Vec2f uv;
+        float intensity;
+
+        Varyings operator +(const Varyings &v) const { Varyings r; r.uv = uv+v.uv; r.intensity = intensity+v.intensity; return r; }
+        Varyings operator *(float f) const { Varyings r; r.uv = uv*f; r.intensity = intensity*f; return r; }
+    };
+
+    GouraudShader(Model *m, const Vec3f &l) : ShaderBase(m, l) {}
+
+    void vertex(int iface, int nthvert, Varyings &out) {
+        Vec3f n = model->normal(iface, nthvert);
+        out.intensity = std::max(0.f, -(n.normalize()*light_dir));
+        out.uv = model->uv(model->face_uv(iface)[nthvert]);
+    }
+
+    bool fragment(const Varyings &in, TGAColor &color) const {
+        color = scale_color(model->diffuse(in.uv), std::min(1.f, in.intensity));
+        return true;
+    }
+};
+
+// нормаль интерполируется, освещение (диффузное + блик) - в каждом пикселе
+struct PhongShader : ShaderBase {
+    struct Varyings {
+        Vec2f uv;
+        Vec3f n;
+
+        Varyings operator +(const Varyings &v) const { Varyings r; r.uv = uv+v.uv; r.n = n+v.n; return r; }
+        Varyings operator *(float f) const { Varyings r; r.uv = uv*f; r.n = n*f; return r; }
+    };
+
+    float specular; // показатель блика
+
+    PhongShader(Model *m, const Vec3f &l) : ShaderBase(m, l), specular(20.f) {}
+
+    void vertex(int iface, int nthvert, Varyings &out) {
+        out.n = model->normal(iface, nthvert);
+        out.uv = model->uv(model->face_uv(iface)[nthvert]);
+    }
+
+    bool fragment(const Varyings &in, TGAColor &color) const {
+        Vec3f n = in.n;
+        n.normalize();
+        float nl = n*light_dir;
+        Vec3f r = light_dir - n*(2.f*nl); // отражённый луч, камера смотрит вдоль -z
+        float diff = std::max(0.f, -nl);
+        float spec = std::pow(std::max(0.f, r.z), specular);
+        color = scale_color(model->diffuse(in.uv), std::min(1.f, diff + .4f*spec));
+        return true;
+    }
+};
+
+template <class Shader>
+void Rasterizer::draw_shaded(Shader &shader, const VertexBuffer &screen, PrimitiveStage &primitives,
+                             Model &model, TGAImage &image, const unsigned char *face_visible) {
+    typedef typename Shader::Varyings Varyings;
+
+    // варинги шейдера клиппер не знает: через него вместо uv идут барицентрики
+    // исходной грани, и варинги вершин после отсечения собираются по ним.
+    // Неразрезанная грань получает ровно свои варинги: веса 1, 0, 0
+    static const Vec2f corner[3] = { Vec2f(0.f, 0.f), Vec2f(1.f, 0.f), Vec2f(0.f, 1.f) };
+    std::vector<RasterTriangle> clipped;
+    std::vector<ShadedTriangle<Varyings> > tris;
+    tris.reserve(model.nfaces());
+    for (int i=0; i<model.nfaces(); i++) {
+        if (face_visible && !face_visible[i]) continue;
+        Span<int> face = model.face(i);
+        ClipVertex clip[3];
+        for (int j=0; j<3; j++) clip[j] = ClipVertex(screen.at(face[j]), corner[j]);
+        clipped.clear();
+        primitives.add(clip, 0.f, clipped);
+        if (clipped.empty()) continue;
+
+        Varyings vary[3];
+        for (int j=0; j<3; j++) shader.vertex(i, j, vary[j]);
+        for (size_t k=0; k<clipped.size(); k++) {
+            ShadedTriangle<Varyings> t;
+            for (int j=0; j<3; j++) {
+                const Vec2f &w = clipped[k].uvs[j];
+                t.pts[j] = clipped[k].pts[j];
+                t.vary[j] = interpolate(vary, Vec3f(1.f-w.x-w.y, w.x, w.y));
+            }
+            tris.push_back(t);
+        }
+    }
+
+    bin(tris);
+    run_tiles(model, image, [&](int tile, RasterTarget &target) {
+        TileRect r = tile_rect(tile);
+        const std::vector<int> &bin = bins_[tile];
+        if (bin.empty()) return;
+        if (target.vis_id)
+            for (int y=r.y0; y<=r.y1; y++)
+                std::fill(target.vis_id + r.x0 + y*width_, target.vis_id + r.x1+1 + y*width_, -1);
+
+        for (size_t i=0; i<bin.size(); i++) {
+            const ShadedTriangle<Varyings> &t = tris[bin[i]];
+            rasterize_edges(t.pts, r, target, [&](int x, int y, const Vec3f &bc) {
+                if (target.vis_id) {
+                    target.vis_id[x + y*width_] = bin[i];
+                    target.vis_bc[x + y*width_] = bc;
+                    return true;
+                }
+                TGAColor color;
+                if (!shader.fragment(interpolate(t.vary, bc), color)) return false;
+                target.image->set(x, y, color);
+                return true;
+            });
+        }
+
+        if (!target.vis_id) return;
+        // отложенный режим: fragment() один раз на видимый пиксель
+        for (int y=r.y0; y<=r.y1; y++) {
+            for (int x=r.x0; x<=r.x1; x++) {
+                int idx = x + y*width_;
+                if (target.vis_id[idx]<0) continue;
+                TGAColor color;
+                if (shader.fragment(interpolate(tris[target.vis_id[idx]].vary, target.vis_bc[idx]), color))
+                    target.image->set(x, y, color);
+                target.stats.resolved++;
+            }
+        }
+    });
+}
+
+#endif // __SHADER_H__
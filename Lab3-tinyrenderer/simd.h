@@ -0,0 +1,137 @@
+// simd.h
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+// 8 float'ов в одном регистре: AVX2 -> __m256, SSE2 -> два __m128, иначе массив.
+// бэкенд выбирается при сборке по флагам компилятора (-mavx2 / x86-64 по умолчанию)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#else
+#include <cmath>
+#endif
+
+struct Float8 {
+#if defined(SIMD_AVX2)
+    __m256 v;
+    Float8() {}
+    Float8(__m256 _v) : v(_v) {}
+    Float8(float f) : v(_mm256_set1_ps(f)) {}
+    static Float8 load(const float *p) { return _mm256_loadu_ps(p); }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+    static Float8 ramp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+    // целые без знака -> float; для load_u32 значения меньше 2^24
+    static Float8 load_u16(const unsigned short *p) {
+        return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p)));
+    }
+    static Float8 load_u32(const unsigned int *p) {
+        return _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)p));
+    }
+
+    Float8 operator +(const Float8 &b) const { return _mm256_add_ps(v, b.v); }
+    Float8 operator -(const Float8 &b) const { return _mm256_sub_ps(v, b.v); }
+    Float8 operator *(const Float8 &b) const { return _mm256_mul_ps(v, b.v); }
+    Float8 operator /(const Float8 &b) const { return _mm256_div_ps(v, b.v); }
+    Float8 operator &(const Float8 &b) const { return _mm256_and_ps(v, b.v); }
+    Float8 operator |(const Float8 &b) const { return _mm256_or_ps(v, b.v); }
+    Float8 operator >=(const Float8 &b) const { return _mm256_cmp_ps(v, b.v, _CMP_GE_OQ); }
+    Float8 operator >(const Float8 &b) const { return _mm256_cmp_ps(v, b.v, _CMP_GT_OQ); }
+    Float8 operator <(const Float8 &b) const { return _mm256_cmp_ps(v, b.v, _CMP_LT_OQ); }
+    int movemask() const { return _mm256_movemask_ps(v); }
+    friend Float8 min(const Float8 &a, const Float8 &b) { return _mm256_min_ps(a.v, b.v); }
+    friend Float8 max(const Float8 &a, const Float8 &b) { return _mm256_max_ps(a.v, b.v); }
+    friend Float8 sqrt(const Float8 &a) { return _mm256_sqrt_ps(a.v); }
+    friend Float8 abs(const Float8 &a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v); }
+    // mask ? a : b по дорожкам
+    friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+    float hmin() const {
+        __m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+#elif defined(SIMD_SSE2)
+    __m128 lo, hi;
+    Float8() {}
+    Float8(__m128 l, __m128 h) : lo(l), hi(h) {}
+    Float8(float f) : lo(_mm_set1_ps(f)), hi(lo) {}
+    static Float8 load(const float *p) { return Float8(_mm_loadu_ps(p), _mm_loadu_ps(p+4)); }
+    void store(float *p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p+4, hi); }
+    static Float8 ramp() { return Float8(_mm_setr_ps(0, 1, 2, 3), _mm_setr_ps(4, 5, 6, 7)); }
+    static Float8 load_u16(const unsigned short *p) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p), zero = _mm_setzero_si128();
+        return Float8(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+    }
+    static Float8 load_u32(const unsigned int *p) {
+        return Float8(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)p)),
+                      _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(p+4))));
+    }
+
+    Float8 operator +(const Float8 &b) const { return Float8(_mm_add_ps(lo, b.lo), _mm_add_ps(hi, b.hi)); }
+    Float8 operator -(const Float8 &b) const { return Float8(_mm_sub_ps(lo, b.lo), _mm_sub_ps(hi, b.hi)); }
+    Float8 operator *(const Float8 &b) const { return Float8(_mm_mul_ps(lo, b.lo), _mm_mul_ps(hi, b.hi)); }
+    Float8 operator /(const Float8 &b) const { return Float8(_mm_div_ps(lo, b.lo), _mm_div_ps(hi, b.hi)); }
+    Float8 operator &(const Float8 &b) const { return Float8(_mm_and_ps(lo, b.lo), _mm_and_ps(hi, b.hi)); }
+    Float8 operator |(const Float8 &b) const { return Float8(_mm_or_ps(lo, b.lo), _mm_or_ps(hi, b.hi)); }
+    Float8 operator >=(const Float8 &b) const { return Float8(_mm_cmpge_ps(lo, b.lo), _mm_cmpge_ps(hi, b.hi)); }
+    Float8 operator >(const Float8 &b) const { return Float8(_mm_cmpgt_ps(lo, b.lo), _mm_cmpgt_ps(hi, b.hi)); }
+    Float8 operator <(const Float8 &b) const { return Float8(_mm_cmplt_ps(lo, b.lo), _mm_cmplt_ps(hi, b.hi)); }
+    int movemask() const { return _mm_movemask_ps(lo) | (_mm_movemask_ps(hi) << 4); }
+    friend Float8 min(const Float8 &a, const Float8 &b) { return Float8(_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)); }
+    friend Float8 max(const Float8 &a, const Float8 &b) { return Float8(_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)); }
+    friend Float8 sqrt(const Float8 &a) { return Float8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+    friend Float8 abs(const Float8 &a) {
+        __m128 sign = _mm_set1_ps(-0.f);
+        return Float8(_mm_andnot_ps(sign, a.lo), _mm_andnot_ps(sign, a.hi));
+    }
+    friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b) {
+        return Float8(_mm_or_ps(_mm_and_ps(mask.lo, a.lo), _mm_andnot_ps(mask.lo, b.lo)),
+                      _mm_or_ps(_mm_and_ps(mask.hi, a.hi), _mm_andnot_ps(mask.hi, b.hi)));
+    }
+    float hmin() const {
+        __m128 m = _mm_min_ps(lo, hi);
+        m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+#else
+    float v[8];
+    Float8() {}
+    Float8(float f) { for (int i=0; i<8; i++) v[i] = f; }
+    static Float8 load(const float *p) { Float8 r; for (int i=0; i<8; i++) r.v[i] = p[i]; return r; }
+    void store(float *p) const { for (int i=0; i<8; i++) p[i] = v[i]; }
+    static Float8 ramp() { Float8 r; for (int i=0; i<8; i++) r.v[i] = (float)i; return r; }
+    static Float8 load_u16(const unsigned short *p) { Float8 r; for (int i=0; i<8; i++) r.v[i] = (float)p[i]; return r; }
+    static Float8 load_u32(const unsigned int *p) { Float8 r; for (int i=0; i<8; i++) r.v[i] = (float)p[i]; return r; }
+
+    Float8 operator +(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = v[i]+b.v[i]; return r; }
+    Float8 operator -(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = v[i]-b.v[i]; return r; }
+    Float8 operator *(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = v[i]*b.v[i]; return r; }
+    Float8 operator /(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = v[i]/b.v[i]; return r; }
+    // маски в скалярном бэкенде: 1.f - истина, 0.f - ложь
+    Float8 operator &(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = (v[i]!=0 && b.v[i]!=0) ? 1.f : 0.f; return r; }
+    Float8 operator |(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = (v[i]!=0 || b.v[i]!=0) ? 1.f : 0.f; return r; }
+    Float8 operator >=(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = v[i]>=b.v[i] ? 1.f : 0.f; return r; }
+    Float8 operator >(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = v[i]>b.v[i] ? 1.f : 0.f; return r; }
+    Float8 operator <(const Float8 &b) const { Float8 r; for (int i=0; i<8; i++) r.v[i] = v[i]<b.v[i] ? 1.f : 0.f; return r; }
+    int movemask() const { int m = 0; for (int i=0; i<8; i++) if (v[i]!=0) m |= 1<<i; return m; }
+    friend Float8 min(const Float8 &a, const Float8 &b) { Float8 r; for (int i=0; i<8; i++) r.v[i] = a.v[i]<b.v[i] ? a.v[i] : b.v[i]; return r; }
+    friend Float8 max(const Float8 &a, const Float8 &b) { Float8 r; for (int i=0; i<8; i++) r.v[i] = a.v[i]>b.v[i] ? a.v[i] : b.v[i]; return r; }
+    friend Float8 sqrt(const Float8 &a) { Float8 r; for (int i=0; i<8; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+    friend Float8 abs(const Float8 &a) { Float8 r; for (int i=0; i<8; i++) r.v[i] = std::fabs(a.v[i]); return r; }
+    friend Float8 select(const Float8 &mask, const Float8 &a, const Float8 &b) { Float8 r; for (int i=0; i<8; i++) r.v[i] = mask.v[i]!=0 ? a.v[i] : b.v[i]; return r; }
+    float hmin() const { float m = v[0]; for (int i=1; i<8; i++) m = m<v[i] ? m : v[i]; return m; }
+#endif
+};
+
+// число единиц в 8-битной маске movemask()
+inline int popcount8(int m) {
+    m = (m & 0x55) + ((m >> 1) & 0x55);
+    m = (m & 0x33) + ((m >> 2) & 0x33);
+    return (m & 0x0f) + (m >> 4);
+}
+
+#endif // __SIMD_H__
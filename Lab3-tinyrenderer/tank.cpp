@@ -1,6 +1,7 @@
 #include <cmath>
 #include <algorithm>
 #include "tank.h"
+#include "packet.h"
 
 const int STEPS = 60;
 const float MAX_DIST = 15.0f;
@@ -56,31 +57,105 @@ bool raymarchTank(const Vec3f &cameraPos, const Vec3f &rayDir, float &tHit) {
     return false; //рандеву танчика и луча не состоялся(ось) хз
 }
 
-void render_tank(TGAImage &image) {
-    const int tankSize = 600;
+// те же функции для 8 лучей сразу (packet.h), дорожка = скалярный результат
 
+static Float8 sdBox8(const Vec3f8 &p, const Vec3f &b) {
+    Vec3f8 q = abs(p) - Vec3f8(b);
+    Vec3f8 d = max(q, Vec3f8(Vec3f(0, 0, 0)));
+    Float8 outside = sqrt(d.x*d.x + d.y*d.y + d.z*d.z);
+    Float8 inside  = min(max(q.x, max(q.y, q.z)), Float8(0.f));
+    return outside+inside;
+}
+
+static Float8 mapTank8(const Vec3f8 &p) {
+    Vec3f8 pr(Float8(-0.f) - p.z, p.y, p.x);
+
+    Float8 d = sdBox8(pr - Vec3f8(Vec3f(0, 0.3, 0)), Vec3f(0.7, 0.2, 0.5));
+    Float8 turret = sdBox8(pr - Vec3f8(Vec3f(0, 0.7, 0)), Vec3f(0.4, 0.2, 0.3));
+    Float8 gun = sdBox8(pr - Vec3f8(Vec3f(0, 0.7, 0.7)), Vec3f(0.05, 0.05, 0.5));
+    return min(min(d, turret), min(d, gun));
+}
+
+static Vec3f8 tankNormal8(const Vec3f8 &p) {
+    const Float8 e(0.01f);
+    Float8 dx = mapTank8(Vec3f8(p.x + e, p.y, p.z)) - mapTank8(Vec3f8(p.x-e, p.y, p.z));
+    Float8 dy = mapTank8(Vec3f8(p.x, p.y + e, p.z)) - mapTank8(Vec3f8(p.x, p.y-e, p.z));
+    Float8 dz = mapTank8(Vec3f8(p.x, p.y, p.z + e)) - mapTank8(Vec3f8(p.x, p.y, p.z-e));
+    Vec3f8 n(dx, dy, dz);
+    return n.normalize();
+}
+
+// active - какие дорожки считать; возвращает маску попаданий, tHit - по дорожкам.
+// Дорожка выбывает, когда попала или ушла дальше MAX_DIST, цикл - пока есть живые
+static Float8 raymarchTank8(const Vec3f &cameraPos, const Vec3f8 &rayDir, Float8 active, Float8 &tHit) {
+    Vec3f8 cam(cameraPos);
+    Float8 rayDistance(0.f), hit(0.f);
+    tHit = Float8(0.f);
+    for (int i = 0; i < STEPS && active.movemask(); i++) {
+        Vec3f8 p = cam + rayDir*rayDistance;
+        Float8 d = mapTank8(p);
+        Float8 h = active & (d < Float8(SURF_DIST));
+        tHit = select(h, rayDistance, tHit);
+        hit = hit | h;
+        active = active & (d >= Float8(SURF_DIST));
+        rayDistance = select(active, rayDistance + d, rayDistance);
+        active = active & (Float8(MAX_DIST) >= rayDistance);
+    }
+    return hit;
+}
+
+bool tank_pixel(int x, int y, TGAColor &color) {
+    if (x < 0 || y < 0 || x >= TANK_SIZE || y >= TANK_SIZE) return false;
+
+    Vec3f cameraPos(1, 1, -5);
+
+    float u = (x/float(TANK_SIZE))*2 - 1;
+    float v = (y/float(TANK_SIZE))*2 - 1; //[-1; 1]
+
+    Vec3f rayDir(u, v, 1);
+    rayDir.normalize();
+
+    float tHit;
+    if (!raymarchTank(cameraPos, rayDir, tHit)) return false;
+    Vec3f p = cameraPos + rayDir*tHit;
+    Vec3f norm = tankNormal(p);
+    float diff = 0.5f * (norm.y + 1.0f);
+
+    color = TGAColor(0, diff*200, 0, 255);
+    return true;
+}
+
+void render_tank(TGAImage &image, int x0, int y0) {
     int imgW = image.get_width();
     int imgH = image.get_height();
 
     Vec3f cameraPos(1, 1, -5);
 
-    for (int y = 0; y < tankSize; y++) {
-        for (int x = 0; x < tankSize; x++) {
-            int ix = x; // где х
-            int iy = y + 400; // где у
-            if (ix < 0 || iy < 0 || ix >= imgW || iy >= imgH) continue;
-
-            float u = (x/float(tankSize))*2 - 1;
-            float v = (y/float(tankSize))*2 - 1; //[-1; 1]
+    // только пересечение квадрата танка с окном; по 8 пикселей строки за раз
+    int xs = std::max(0, x0 - TANK_X), xe = std::min(TANK_SIZE, x0 + imgW - TANK_X);
+    int ys = std::max(0, y0 - TANK_Y), ye = std::min(TANK_SIZE, y0 + imgH - TANK_Y);
+    for (int y = ys; y < ye; y++) {
+        for (int x = xs; x < xe; x += 8) {
+            float u[8];
+            for (int i = 0; i < 8; i++) u[i] = ((x+i)/float(TANK_SIZE))*2 - 1;
+            float v = (y/float(TANK_SIZE))*2 - 1; //[-1; 1]
 
-            Vec3f rayDir(u, v, 1);
+            Vec3f8 rayDir(Float8::load(u), Float8(v), Float8(1.f));
             rayDir.normalize();
 
-            float tHit;
-            if (raymarchTank(cameraPos, rayDir, tHit)) {
-                Vec3f p = cameraPos + rayDir*tHit;
-                Vec3f norm = tankNormal(p);
-                float diff = 0.5f * (norm.y + 1.0f);
+            Float8 active = Float8::ramp() + Float8((float)x) < Float8((float)xe);
+            Float8 tHit;
+            int hit = raymarchTank8(cameraPos, rayDir, active, tHit).movemask();
+            if (!hit) continue;
+
+            Vec3f8 p = Vec3f8(cameraPos) + rayDir*tHit;
+            Vec3f8 norm = tankNormal8(p);
+            float diff[8];
+            (Float8(0.5f) * (norm.y + Float8(1.0f))).store(diff);
 
-                image.set(ix, iy, TGAColor(0, diff*200, 0, 255));
-}}}}
\ No newline at end of file
+            for (int i = 0; i < 8; i++)
+                if (hit & (1 << i))
+                    image.set(x + i + TANK_X - x0, y + TANK_Y - y0, TGAColor(0, diff[i]*200, 0, 255)); // где х, у в окне
+        }
+    }
+}
@@ -5,6 +5,14 @@
 #include "geometry.h"
 #include "tgaimage.h"
 
-void render_tank(TGAImage &image);
+// квадрат кадра, в который рисуется танк
+static const int TANK_X = 0, TANK_Y = 400, TANK_SIZE = 600;
+
+// луч через пиксель (x, y) квадрата танка; false - мимо или вне квадрата
+bool tank_pixel(int x, int y, TGAColor &color);
+
+// image - окно кадра с левым нижним углом (x0, y0): лучи пускаются только
+// через пиксели окна
+void render_tank(TGAImage &image, int x0 = 0, int y0 = 0);
 
 #endif // __TANK_H__
@@ -0,0 +1,78 @@
+// imgtool.cpp - вспомогательная программа регрессионных тестов (tests/run.cmake)
+//
+//   imgtool texture OUT.tga [flat]          процедурная текстура вместо _diffuse.tga (flat - одного цвета)
+//   imgtool compare A.tga B.tga [MAX]       не больше MAX (0) различающихся пикселей
+//   imgtool crop FULL.tga PART.tga X0 Y0    PART совпадает с окном FULL, (X0, Y0) снизу
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "../tgaimage.h"
+
+// в репозитории нет текстуры головы, а без неё все грани чёрные и тест ничего не
+// проверяет; у этой каждый тексель свой, так что ошибка uv сразу видна в картинке
+// одноцветная - там, где от uv ничего не зависит: цвет пикселя - освещённость и покрытие
+static int texture(const char *out, bool flat) {
+    const int size = 512;
+    TGAImage img(size, size, TGAImage::RGB);
+    for (int y=0; y<size; y++)
+        for (int x=0; x<size; x++)
+            img.set(x, y, flat ? TGAColor(200, 160, 120, 255) : TGAColor(x/2, y/2, (x^y)&255, 255));
+    return img.write_tga_file(out) ? 0 : 1;
+}
+
+// картинка как в кадре: строка 0 - нижняя (main переворачивает перед записью)
+static bool load(const char *name, TGAImage &img) {
+    if (!img.read_tga_file(name)) {
+        std::cerr << "can't read " << name << std::endl;
+        return false;
+    }
+    img.flip_vertically();
+    return true;
+}
+
+static bool same_pixel(TGAImage &a, int ax, int ay, TGAImage &b, int bx, int by) {
+    TGAColor ca = a.get(ax, ay), cb = b.get(bx, by);
+    return !memcmp(ca.raw, cb.raw, a.get_bytespp());
+}
+
+static int compare(const char *an, const char *bn, long max_diff) {
+    TGAImage a, b;
+    if (!load(an, a) || !load(bn, b)) return 1;
+    if (a.get_width()!=b.get_width() || a.get_height()!=b.get_height() || a.get_bytespp()!=b.get_bytespp()) {
+        std::cerr << an << " and " << bn << ": different sizes" << std::endl;
+        return 1;
+    }
+    long diff = 0;
+    for (int y=0; y<a.get_height(); y++)
+        for (int x=0; x<a.get_width(); x++)
+            if (!same_pixel(a, x, y, b, x, y)) diff++;
+    std::cerr << "# " << an << " vs " << bn << ": " << diff << " of "
+              << (long)a.get_width()*a.get_height() << " pixels differ" << std::endl;
+    return diff>max_diff ? 1 : 0;
+}
+
+static int crop(const char *fulln, const char *partn, int x0, int y0) {
+    TGAImage full, part;
+    if (!load(fulln, full) || !load(partn, part)) return 1;
+    if (x0<0 || y0<0 || x0+part.get_width()>full.get_width() || y0+part.get_height()>full.get_height()
+            || full.get_bytespp()!=part.get_bytespp()) {
+        std::cerr << partn << " is not a window of " << fulln << std::endl;
+        return 1;
+    }
+    long diff = 0;
+    for (int y=0; y<part.get_height(); y++)
+        for (int x=0; x<part.get_width(); x++)
+            if (!same_pixel(full, x0+x, y0+y, part, x, y)) diff++;
+    std::cerr << "# " << partn << " vs window of " << fulln << ": " << diff << " of "
+              << (long)part.get_width()*part.get_height() << " pixels differ" << std::endl;
+    return diff ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+    if ((argc==3 || argc==4) && !strcmp(argv[1], "texture")) return texture(argv[2], argc==4 && !strcmp(argv[3], "flat"));
+    if ((argc==4 || argc==5) && !strcmp(argv[1], "compare")) return compare(argv[2], argv[3], argc==5 ? atol(argv[4]) : 0);
+    if (argc==6 && !strcmp(argv[1], "crop")) return crop(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]));
+    std::cerr << "usage: imgtool texture OUT [flat] | compare A B [MAX] | crop FULL PART X0 Y0" << std::endl;
+    return 2;
+}
@@ -0,0 +1,110 @@
+# run.cmake - один регрессионный тест: рендер головы в своём каталоге WORK
+#
+#   RENDERER, IMGTOOL  программы
+#   MODEL              OBJ, копируется в WORK как head.obj с процедурной текстурой
+#   TEXTURE            flat - текстура одного цвета
+#   ARGS               ключи tinyrenderer через пробел
+#   OUTPUT             картинка первого рендера вместо output.tga (view_0.tga у --views)
+#   MD5                ожидаемая сумма output.tga
+#   REF                ключи второго рендера; картинки должны совпасть до MAX_DIFF пикселей
+#   CROP "x y w h"     ещё рендер с --crop, окно должно совпасть с полным кадром до пикселя
+#   REPEAT             второй рендер с теми же ключами (кэш), его stderr должен содержать LOG,
+#                      а картинка - совпасть с первой; TOUCH - перед ним обновить время OBJ
+#   STATS              stderr первого рендера должен содержать STATS; строки времени
+#                      и отсечения обоих рендеров выводятся (для --bench)
+#   NOT_LESS           regex с двумя числами в stderr первого рендера: второе не меньше первого
+
+file(REMOVE_RECURSE "${WORK}")
+file(MAKE_DIRECTORY "${WORK}")
+configure_file("${MODEL}" "${WORK}/head.obj" COPYONLY)
+
+function(run)
+    execute_process(COMMAND ${ARGN} WORKING_DIRECTORY "${WORK}" RESULT_VARIABLE rc ERROR_VARIABLE err)
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "${ARGN}: exit ${rc}\n${err}")
+    endif()
+    set(err "${err}" PARENT_SCOPE)
+endfunction()
+
+# рендер с ключами args в файл name; третий аргумент - файл, который пишет рендерер
+function(render name args)
+    set(src output.tga)
+    if(ARGC GREATER 2)
+        set(src "${ARGV2}")
+    endif()
+    separate_arguments(list UNIX_COMMAND "${args}")
+    run("${RENDERER}" --model head.obj ${list})
+    file(RENAME "${WORK}/${src}" "${WORK}/${name}")
+    set(err "${err}" PARENT_SCOPE)
+endfunction()
+
+function(check_md5 name)
+    file(MD5 "${WORK}/${name}" sum)
+    if(NOT sum STREQUAL MD5)
+        message(FATAL_ERROR "${name} (${ARGS}): md5 ${sum}, expected ${MD5}")
+    endif()
+endfunction()
+
+function(print_stats label)
+    string(REGEX MATCHALL "# (occlusion|raster|fragments)[^\n]*" lines "${err}")
+    foreach(line ${lines})
+        message("${label}: ${line}")
+    endforeach()
+endfunction()
+
+run("${IMGTOOL}" texture head_diffuse.tga ${TEXTURE})
+if(NOT OUTPUT)
+    set(OUTPUT output.tga)
+endif()
+render(out.tga "${ARGS}" ${OUTPUT})
+if(DEFINED MD5)
+    check_md5(out.tga)
+endif()
+if(DEFINED STATS)
+    if(NOT err MATCHES "${STATS}")
+        message(FATAL_ERROR "render (${ARGS}) has no '${STATS}' in:\n${err}")
+    endif()
+    print_stats("${ARGS}")
+endif()
+
+if(DEFINED NOT_LESS)
+    if(NOT err MATCHES "${NOT_LESS}")
+        message(FATAL_ERROR "render (${ARGS}) has no '${NOT_LESS}' in:\n${err}")
+    endif()
+    if(CMAKE_MATCH_2 LESS CMAKE_MATCH_1)
+        message(FATAL_ERROR "render (${ARGS}): ${CMAKE_MATCH_0} - ${CMAKE_MATCH_2} is less than ${CMAKE_MATCH_1}")
+    endif()
+    message("${CMAKE_MATCH_0}")
+endif()
+
+if(DEFINED REF)
+    render(ref.tga "${REF}")
+    if(DEFINED STATS)
+        print_stats("${REF}")
+    endif()
+    if(NOT MAX_DIFF)
+        set(MAX_DIFF 0)
+    endif()
+    run("${IMGTOOL}" compare out.tga ref.tga ${MAX_DIFF})
+    message("${err}")
+endif()
+
+if(DEFINED CROP)
+    separate_arguments(window UNIX_COMMAND "${CROP}")
+    list(GET window 0 x0)
+    list(GET window 1 y0)
+    render(crop.tga "${ARGS} --crop ${CROP}")
+    run("${IMGTOOL}" crop out.tga crop.tga ${x0} ${y0})
+    message("${err}")
+endif()
+
+if(REPEAT)
+    if(TOUCH)
+        file(TOUCH "${WORK}/head.obj")
+    endif()
+    render(again.tga "${ARGS}" ${OUTPUT})
+    if(NOT err MATCHES "${LOG}")
+        message(FATAL_ERROR "second run (${ARGS}) has no '${LOG}' in:\n${err}")
+    endif()
+    run("${IMGTOOL}" compare out.tga again.tga)
+endif()
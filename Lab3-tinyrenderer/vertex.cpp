@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <thread>
+#include "packet.h"
+#include "vertex.h"
+
+void VertexBuffer::resize(int n) {
+    size = n;
+    int padded = (n+7) & ~7;
+    x.resize(padded);
+    y.resize(padded);
+    z.resize(padded);
+    w.resize(padded);
+}
+
+void load_positions(Model &model, VertexBuffer &positions) {
+    int n = model.nverts();
+    positions.resize(n);
+    if (model.is_compact()) {
+        for (int i=0; i<n; i++) {
+            Vec3f v = model.vert(i);
+            positions.x[i] = v.x;
+            positions.y[i] = v.y;
+            positions.z[i] = v.z;
+        }
+    } else {
+        std::copy(model.xs().begin(), model.xs().end(), positions.x.begin());
+        std::copy(model.ys().begin(), model.ys().end(), positions.y.begin());
+        std::copy(model.zs().begin(), model.zs().end(), positions.z.begin());
+    }
+    // хвост до кратного 8 тоже точки, чтобы не делить на ноль
+    std::fill(positions.w.begin(), positions.w.end(), 1.f);
+}
+
+// пакет из 8 позиций с i-й
+static Vec4f8 load_packet(const VertexBuffer &in, int i) {
+    return Vec4f8(Float8::load(&in.x[i]), Float8::load(&in.y[i]), Float8::load(&in.z[i]), Float8::load(&in.w[i]));
+}
+
+static Vec4f8 load_packet(const QuantizedPositions &in, int i) {
+    Vec3f8 v(Float8(in.lo.x) + Float8::load_u16(in.x+i)*Float8(in.step.x),
+             Float8(in.lo.y) + Float8::load_u16(in.y+i)*Float8(in.step.y),
+             Float8(in.lo.z) + Float8::load_u16(in.z+i)*Float8(in.step.z));
+    return Vec4f8(v, Float8(1.f));
+}
+
+// вершины [begin, end), begin и end кратны 8
+template <class Source>
+static void transform_range(const Source *in, const Mat4 *m, VertexBuffer *out, int begin, int end) {
+    for (int i=begin; i<end; i+=8) {
+        Vec4f8 c = (*m) * load_packet(*in, i);
+        c.x.store(&out->x[i]);
+        c.y.store(&out->y[i]);
+        c.z.store(&out->z[i]);
+        c.w.store(&out->w[i]);
+    }
+}
+
+template <class Source>
+static void transform_all(const Source &positions, int size, const Mat4 &transform, int threads, VertexBuffer &out) {
+    out.resize(size);
+    int padded = (int)out.x.size();
+    if (threads<=0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, padded / VERTEX_CHUNK));
+    int chunk = ((padded/threads + 7) & ~7);
+
+    std::vector<std::thread> pool;
+    for (int t=1; t<threads; t++) {
+        int begin = std::min(padded, t*chunk), end = t+1==threads ? padded : std::min(padded, (t+1)*chunk);
+        pool.push_back(std::thread(transform_range<Source>, &positions, &transform, &out, begin, end));
+    }
+    transform_range(&positions, &transform, &out, 0, std::min(padded, chunk));
+    for (size_t t=0; t<pool.size(); t++) pool[t].join();
+}
+
+void transform_vertices(const VertexBuffer &positions, const Mat4 &transform, int threads, VertexBuffer &out) {
+    transform_all(positions, positions.size, transform, threads, out);
+}
+
+void transform_vertices(const QuantizedPositions &positions, const Mat4 &transform, int threads, VertexBuffer &out) {
+    transform_all(positions, positions.size, transform, threads, out);
+}
@@ -0,0 +1,36 @@
+// vertex.h
+#ifndef __VERTEX_H__
+#define __VERTEX_H__
+
+#include <vector>
+#include "matrix.h"
+#include "model.h"
+
+// вершинная стадия: каждая вершина модели преобразуется один раз за кадр,
+// грани потом только индексируют результат (кэш вершин после преобразования)
+
+// на поток не меньше стольких вершин, иначе запуск потоков дороже работы
+static const int VERTEX_CHUNK = 4096;
+
+// вершины структурой массивов; длина массивов кратна 8 для пакетов Float8
+struct VertexBuffer {
+    std::vector<float> x, y, z, w;
+    int size;
+
+    VertexBuffer() : size(0) {}
+    void resize(int n);
+    Vec4f at(int i) const { return Vec4f(x[i], y[i], z[i], w[i]); }
+};
+
+// позиции модели с w=1, один раз после загрузки; компактная модель декодируется
+void load_positions(Model &model, VertexBuffer &positions);
+
+// out = transform * positions, то есть координаты до деления на w, как у
+// ClipVertex; пакетами по 8, вершины делятся между потоками (0 - по числу ядер).
+// Результат побитово равен transform * Vec4f(v, 1.f)
+void transform_vertices(const VertexBuffer &positions, const Mat4 &transform, int threads, VertexBuffer &out);
+// то же из компактной модели: читается 6 байт на вершину вместо 16, позиции
+// декодируются в пакете; результат побитово равен transform * Vec4f(model.vert(i), 1.f)
+void transform_vertices(const QuantizedPositions &positions, const Mat4 &transform, int threads, VertexBuffer &out);
+
+#endif // __VERTEX_H__
@@ -0,0 +1,203 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "wireframe.h"
+#include "primitive.h"
+
+std::vector<Vec2i> unique_edges(Model &model) {
+    std::vector<long long> keys;
+    keys.reserve(model.nfaces()*3);
+    for (int i=0; i<model.nfaces(); i++) {
+        Span<int> face = model.face(i);
+        for (int j=0; j<3; j++) {
+            long long a = face[j], b = face[(j+1)%3];
+            if (a>b) std::swap(a, b);
+            keys.push_back((a << 32) | b);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::vector<Vec2i> edges(keys.size());
+    for (size_t i=0; i<keys.size(); i++) edges[i] = Vec2i(int(keys[i] >> 32), int(keys[i] & 0xffffffff));
+    return edges;
+}
+
+std::vector<RasterLine> wire_lines(Model &model, const VertexBuffer &screen, int width, int height) {
+    TileRect frame = { 0, 0, width-1, height-1 };
+    std::vector<Vec2i> edges = unique_edges(model);
+    std::vector<RasterLine> lines;
+    lines.reserve(edges.size());
+    for (size_t i=0; i<edges.size(); i++) {
+        ClipVertex a(screen.at(edges[i].x), Vec2f()), b(screen.at(edges[i].y), Vec2f());
+        if (a.w<NEAR_W && b.w<NEAR_W) continue;
+        // ближняя плоскость: конец за ней сдвигаем на w = NEAR_W
+        if (a.w<NEAR_W || b.w<NEAR_W) {
+            ClipVertex &out = a.w<NEAR_W ? a : b;
+            const ClipVertex &in = a.w<NEAR_W ? b : a;
+            float t = (in.w - NEAR_W) / (in.w - out.w);
+            out.x = in.x + (out.x - in.x)*t;
+            out.y = in.y + (out.y - in.y)*t;
+            out.z = in.z + (out.z - in.z)*t;
+            out.w = NEAR_W;
+        }
+        float x0 = a.x/a.w, y0 = a.y/a.w, x1 = b.x/b.w, y1 = b.y/b.w;
+        float z0 = a.z/a.w, z1 = b.z/b.w;
+        float len = std::max(std::fabs(x1-x0), std::fabs(y1-y0));
+        float cx0 = x0, cy0 = y0, cx1 = x1, cy1 = y1;
+        if (!clip_line(cx0, cy0, cx1, cy1, frame)) continue;
+
+        // z на обрезанных концах - по доле длины вдоль большей оси
+        RasterLine l;
+        bool xmajor = std::fabs(x1-x0) >= std::fabs(y1-y0);
+        float t0 = len>0 ? (xmajor ? (cx0-x0)/(x1-x0) : (cy0-y0)/(y1-y0)) : 0.f;
+        float t1 = len>0 ? (xmajor ? (cx1-x0)/(x1-x0) : (cy1-y0)/(y1-y0)) : 1.f;
+        l.x0 = int(cx0 + .5f);
+        l.y0 = int(cy0 + .5f);
+        l.x1 = int(cx1 + .5f);
+        l.y1 = int(cy1 + .5f);
+        l.z0 = z0 + (z1-z0)*t0;
+        l.z1 = z0 + (z1-z0)*t1;
+        lines.push_back(l);
+    }
+    return lines;
+}
+
+enum { CS_LEFT = 1, CS_RIGHT = 2, CS_BOTTOM = 4, CS_TOP = 8 };
+
+static int outcode(float x, float y, const TileRect &r) {
+    int code = 0;
+    if (x<r.x0) code |= CS_LEFT;
+    else if (x>r.x1) code |= CS_RIGHT;
+    if (y<r.y0) code |= CS_BOTTOM;
+    else if (y>r.y1) code |= CS_TOP;
+    return code;
+}
+
+bool clip_line(float &x0, float &y0, float &x1, float &y1, const TileRect &r) {
+    int c0 = outcode(x0, y0, r), c1 = outcode(x1, y1, r);
+    while (true) {
+        if (!(c0 | c1)) return true;
+        if (c0 & c1) return false;
+        // конец снаружи переносим на границу, которую он нарушает
+        int c = c0 ? c0 : c1;
+        float x, y;
+        if (c & CS_TOP)         { x = x0 + (x1-x0)*(r.y1-y0)/(y1-y0); y = r.y1; }
+        else if (c & CS_BOTTOM) { x = x0 + (x1-x0)*(r.y0-y0)/(y1-y0); y = r.y0; }
+        else if (c & CS_RIGHT)  { y = y0 + (y1-y0)*(r.x1-x0)/(x1-x0); x = r.x1; }
+        else                    { y = y0 + (y1-y0)*(r.x0-x0)/(x1-x0); x = r.x0; }
+        if (c==c0) { x0 = x; y0 = y; c0 = outcode(x0, y0, r); }
+        else       { x1 = x; y1 = y; c1 = outcode(x1, y1, r); }
+    }
+}
+
+static inline long long floor_div(long long a, long long b) {
+    long long q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+void line_tile(const RasterLine &l, const TileRect &r, RasterTarget &target, TGAColor color, bool depth_test) {
+    int x0 = l.x0, y0 = l.y0, x1 = l.x1, y1 = l.y1;
+    float z0 = l.z0, z1 = l.z1;
+    // шагаем по большей оси, прямоугольник тайла поворачиваем вместе с отрезком
+    bool steep = std::abs(y1-y0) > std::abs(x1-x0);
+    int rx0 = r.x0, rx1 = r.x1, ry0 = r.y0, ry1 = r.y1;
+    if (steep) {
+        std::swap(x0, y0);
+        std::swap(x1, y1);
+        std::swap(rx0, ry0);
+        std::swap(rx1, ry1);
+    }
+    if (x0>x1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        std::swap(z0, z1);
+    }
+    // участок отрезка над тайлом (с запасом в пиксель на округление y)
+    TileRect band = { rx0-1, ry0-1, rx1+1, ry1+1 };
+    float fx0 = x0, fy0 = y0, fx1 = x1, fy1 = y1;
+    if (!clip_line(fx0, fy0, fx1, fy1, band)) return;
+    int xs = std::max(std::max(x0, rx0), int(std::floor(std::min(fx0, fx1))));
+    int xe = std::min(std::min(x1, rx1), int(std::ceil(std::max(fx0, fx1))));
+    if (xs>xe) return;
+
+    long long dx = x1 - x0, dy = y1 - y0;
+    // y(x) = y0 + floor((2*dy*(x-x0) + dx) / (2*dx)), остаток rem в [0, 2*dx):
+    // начало в середине отрезка даёт те же пиксели, что и проход с x0
+    int y = y0;
+    long long rem = 0;
+    if (dx>0) {
+        long long num = 2*dy*(xs-x0) + dx;
+        long long q = floor_div(num, 2*dx);
+        y = y0 + int(q);
+        rem = num - q*2*dx;
+    }
+    float dz = dx>0 ? (z1-z0)/dx : 0.f;
+
+    unsigned char *buf = target.image->buffer();
+    int bpp = target.image->get_bytespp();
+    for (int x=xs; x<=xe; x++) {
+        if (y>=ry0 && y<=ry1) {
+            int idx = steep ? y + x*target.width : x + y*target.width;
+            float z = z0 + dz*(x-x0);
+            if (depth_test && z + WIRE_DEPTH_BIAS < depth_floor(target, idx)) {
+                target.stats.line_hidden++;
+            } else {
+                memcpy(buf + idx*bpp, color.raw, bpp);
+                target.stats.line_pixels++;
+            }
+        }
+        rem += 2*dy;
+        if (rem>=2*dx) { y++; rem -= 2*dx; }
+        else if (rem<0) { y--; rem += 2*dx; }
+    }
+}
+
+void Rasterizer::draw_lines(const std::vector<RasterLine> &all, Model &model, TGAImage &image,
+                            TGAColor color, bool depth_test) {
+    // в окне: сдвиг на целое число пикселей, Брезенхэм даёт те же пиксели
+    std::vector<RasterLine> shifted;
+    if (origin_x_ || origin_y_) {
+        shifted = all;
+        for (size_t i=0; i<shifted.size(); i++) {
+            shifted[i].x0 -= origin_x_;
+            shifted[i].x1 -= origin_x_;
+            shifted[i].y0 -= origin_y_;
+            shifted[i].y1 -= origin_y_;
+        }
+    }
+    const std::vector<RasterLine> &lines = shifted.empty() ? all : shifted;
+
+    // только тайлы, через которые отрезок проходит: по каждому столбцу (строке)
+    // тайлов вдоль большей оси - диапазон меньшей оси с запасом в пиксель
+    for (size_t i=0; i<bins_.size(); i++) bins_[i].clear();
+    for (size_t i=0; i<lines.size(); i++) {
+        const RasterLine &l = lines[i];
+        bool steep = std::abs(l.y1-l.y0) > std::abs(l.x1-l.x0);
+        int a0 = steep ? l.y0 : l.x0, a1 = steep ? l.y1 : l.x1; // большая ось
+        int b0 = steep ? l.x0 : l.y0, b1 = steep ? l.x1 : l.y1;
+        if (a0>a1) {
+            std::swap(a0, a1);
+            std::swap(b0, b1);
+        }
+        float slope = a1>a0 ? float(b1-b0)/(a1-a0) : 0.f;
+        int nminor = steep ? tiles_x_ : tiles_y_;
+        int amax = steep ? height_-1 : width_-1;
+        // отрезки кадра обрезаны по кадру, но окно может быть меньше
+        if (a1<0 || a0>amax) continue;
+        for (int ta = std::max(a0, 0)/TILE_SIZE; ta<=std::min(a1, amax)/TILE_SIZE; ta++) {
+            int s0 = std::max(a0, ta*TILE_SIZE), s1 = std::min(a1, ta*TILE_SIZE + TILE_SIZE-1);
+            float m0 = b0 + slope*(s0-a0), m1 = b0 + slope*(s1-a0);
+            int tb0 = std::max(0, int(std::min(m0, m1) - 1.f) / TILE_SIZE);
+            int tb1 = std::min(nminor-1, int(std::max(m0, m1) + 1.f) / TILE_SIZE);
+            for (int tb=tb0; tb<=tb1; tb++)
+                bins_[steep ? tb + ta*tiles_x_ : ta + tb*tiles_x_].push_back((int)i);
+        }
+    }
+
+    run_tiles(model, image, [&](int tile, RasterTarget &target) {
+        TileRect r = tile_rect(tile);
+        const std::vector<int> &bin = bins_[tile];
+        for (size_t i=0; i<bin.size(); i++) line_tile(lines[bin[i]], r, target, color, depth_test);
+    });
+}
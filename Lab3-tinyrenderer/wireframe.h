@@ -0,0 +1,38 @@
+// wireframe.h
+#ifndef __WIREFRAME_H__
+#define __WIREFRAME_H__
+
+#include <vector>
+#include "geometry.h"
+#include "matrix.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "vertex.h"
+
+// отрезок в пикселях экрана, уже обрезанный по экрану; z - для сравнения с zbuffer
+struct RasterLine {
+    int x0, y0, x1, y1;
+    float z0, z1;
+};
+
+// допуск z-теста линий: ребро лежит на своей же поверхности, поэтому
+// сравниваем с запасом, иначе линия рвётся об округление z
+static const float WIRE_DEPTH_BIAS = 1.f;
+
+// уникальные рёбра граней model: пары индексов вершин (меньший, больший)
+std::vector<Vec2i> unique_edges(Model &model);
+
+// каждое уникальное ребро один раз: вершины берутся из screen - результата
+// вершинной стадии кадра (transform_vertices), ребро обрезается по ближней
+// плоскости и по экрану
+std::vector<RasterLine> wire_lines(Model &model, const VertexBuffer &screen, int width, int height);
+
+// Коэн-Сазерленд: обрезать отрезок по прямоугольнику r; false - отрезок целиком снаружи
+bool clip_line(float &x0, float &y0, float &x1, float &y1, const TileRect &r);
+
+// отрезок в пределах r целочисленным Брезенхэмом: пиксели совпадают с
+// нерезаным отрезком, как бы его ни делили на тайлы; depth_test - только пиксели
+// не дальше zbuffer (с WIRE_DEPTH_BIAS), zbuffer не меняется
+void line_tile(const RasterLine &l, const TileRect &r, RasterTarget &target, TGAColor color, bool depth_test);
+
+#endif // __WIREFRAME_H__
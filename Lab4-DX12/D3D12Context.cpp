@@ -3,6 +3,8 @@
 #include <cstdio>
 #include <cstring>
 #include <array>
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <vector>
 #include <string>
@@ -677,8 +679,11 @@ void D3D12Context::Draw()
     m_cmdList->IASetVertexBuffers(0, 1, &m_vbv);
     m_cmdList->IASetIndexBuffer(&m_ibv);
 
-    for (const auto& di : m_drawItems)
+    CullDrawItems();
+
+    for (uint32_t item : m_visibleItems)
     {
+        const DrawItem& di = m_drawItems[item];
         D3D12_GPU_DESCRIPTOR_HANDLE srv = base;
         srv.ptr += (UINT64)di.TextureSrvIndex * (UINT64)m_cbvSrvUavDescriptorSize;
         m_cmdList->SetGraphicsRootDescriptorTable(1, srv);
@@ -1098,12 +1103,73 @@ bool D3D12Context::BuildGeometry()
         }
 
         di.TextureSrvIndex = 1 + texResIndex;
+
+        XMVECTOR lo = XMVectorReplicate(FLT_MAX);
+        XMVECTOR hi = XMVectorReplicate(-FLT_MAX);
+        for (uint32_t i = g.start; i < g.start + g.count; i += 3)
+        {
+            XMVECTOR p[3];
+            for (int j = 0; j < 3; ++j)
+            {
+                p[j] = XMLoadFloat3(&model.vertices[model.indices[i + j]].Pos);
+                lo = XMVectorMin(lo, p[j]);
+                hi = XMVectorMax(hi, p[j]);
+            }
+            di.Area += 0.5f * XMVectorGetX(XMVector3Length(XMVector3Cross(p[1] - p[0], p[2] - p[0])));
+        }
+        XMStoreFloat3(&di.BoundsMin, lo);
+        XMStoreFloat3(&di.BoundsMax, hi);
+
         m_drawItems.push_back(di);
     }
 
+    // окклюдеры: DrawItem'ы по убыванию площади (стены, пол, колонны), пока
+    // не кончится бюджет треугольников. Все идут одним вызовом add_occluders:
+    // он сшивает их по совпадающим вершинам, и стыки соседних DrawItem'ов
+    // становятся внутренними рёбрами, а не контуром
+    m_cpuPositions.resize(model.vertices.size());
+    for (size_t i = 0; i < model.vertices.size(); ++i)
+        m_cpuPositions[i] = model.vertices[i].Pos;
+
+    std::vector<uint32_t> order(m_drawItems.size());
+    for (uint32_t i = 0; i < (uint32_t)order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return m_drawItems[a].Area > m_drawItems[b].Area; });
+
+    m_occluderIndices.clear();
+    for (uint32_t item : order)
+    {
+        const DrawItem& di = m_drawItems[item];
+        if (m_occluderIndices.size() / 3 + di.IndexCount / 3 > kOccluderTriangleBudget) continue;
+        m_occluderIndices.insert(m_occluderIndices.end(),
+                                 model.indices.begin() + di.StartIndexLocation,
+                                 model.indices.begin() + di.StartIndexLocation + di.IndexCount);
+    }
+
     return true;
 }
 
+void D3D12Context::CullDrawItems()
+{
+    // OcclusionBuffer ждёт clip = M * (x, y, z, 1), у DirectXMath вектор-строка
+    XMMATRIX wvp = XMLoadFloat4x4(&m_world) * XMLoadFloat4x4(&m_view) * XMLoadFloat4x4(&m_proj);
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, XMMatrixTranspose(wvp));
+
+    m_occlusion.set_transform(&m.m[0][0]);
+    m_occlusion.clear();
+    if (!m_occluderIndices.empty())
+        m_occlusion.add_occluders(&m_cpuPositions[0].x, sizeof(XMFLOAT3), m_occluderIndices.data(),
+                                  (int)(m_occluderIndices.size() / 3));
+
+    m_visibleItems.clear();
+    for (uint32_t i = 0; i < (uint32_t)m_drawItems.size(); ++i)
+    {
+        const DrawItem& di = m_drawItems[i];
+        if (m_occlusion.box_visible(&di.BoundsMin.x, &di.BoundsMax.x))
+            m_visibleItems.push_back(i);
+    }
+}
+
 
 
 bool D3D12Context::BuildConstantBuffer()
@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <vector>
 #include <string>
+#include "occlusion.h"
 
 class D3D12Context
 {
@@ -32,8 +33,15 @@ public:
         uint32_t IndexCount = 0;
         uint32_t StartIndexLocation = 0;
         uint32_t TextureSrvIndex = 1;
+
+        // AABB в координатах модели (до m_world)
+        DirectX::XMFLOAT3 BoundsMin{};
+        DirectX::XMFLOAT3 BoundsMax{};
+        float Area = 0.0f; // суммарная площадь треугольников, для выбора окклюдеров
     };
 
+    const OcclusionStats& GetOcclusionStats() const { return m_occlusion.stats(); }
+
 private:
     bool CreateDevice();
     bool CreateCommandObjects();
@@ -49,6 +57,7 @@ private:
     bool BuildRootSignature();
     bool BuildPSO();
     void UpdateConstantBuffer();
+    void CullDrawItems();
 
     void FlushCommandQueue();
 
@@ -125,6 +134,19 @@ private:
     std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> m_textures;
     std::vector<DrawItem> m_drawItems;
 
+    // отсечение по перекрытию: крупнейшие DrawItem'ы растеризуются в буфер
+    // низкого разрешения, все проверяются по своим AABB. Растеризация консервативная
+    // (края открытых сеток Sponza и щели между DrawItem'ами не закрывают пикселей),
+    // так что окклюдером может быть любой DrawItem, а не только замкнутый
+    static constexpr uint32_t kOcclusionWidth = 320;
+    static constexpr uint32_t kOcclusionHeight = 180;
+    static constexpr uint32_t kOccluderTriangleBudget = 16384;
+
+    OcclusionBuffer m_occlusion{ (int)kOcclusionWidth, (int)kOcclusionHeight };
+    std::vector<DirectX::XMFLOAT3> m_cpuPositions;
+    std::vector<uint32_t> m_occluderIndices; // треугольники выбранных окклюдеров
+    std::vector<uint32_t> m_visibleItems;    // индексы m_drawItems на этот кадр
+
     Microsoft::WRL::ComPtr<ID3D12Resource> m_objectCB;
     uint8_t* m_mappedObjectCB = nullptr;
     uint32_t m_objectCBByteSize = 0;